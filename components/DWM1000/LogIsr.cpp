@@ -36,6 +36,7 @@ LogIsr::LogIsr(Thread& thr)
       logTimer(thr,1,50,true)
 {
     _me = this;
+    logTimer.slack(20); // the buffer holds more than 50 msec of logging
 }
 
 LogIsr::~LogIsr()
@@ -30,15 +30,30 @@ void Neo6m::onRxd(void* me) {
 	((Neo6m*) me)->handleRxd();
 }
 
-void Neo6m::handleRxd() {
+// without demand the sentences are aggregated : a newer one of the same
+// type replaces the pending one, so at most one per NMEA sentence type waits
+void Neo6m::flush() {
+	while ( !_pending.empty() && demand() ) {
+		auto it = _pending.begin();
+		emit({it->first,it->second});
+		_pending.erase(it);
+	}
+}
 
+void Neo6m::handleRxd() {
+	flush();
 	while ( _uart.hasData() ) {
 		char ch = _uart.read();
 		if ( ch=='\n' || ch=='\r') {
 			if ( _line.size()>8 ) { 
 				std::string topic="neo6m/";
 				topic+=_line.substr(1,5);
-				emit({topic,stringify(_line.substr(7))});
+				if ( _pending.empty() && demand() )
+					emit({topic,stringify(_line.substr(7))});
+				else {
+					_pending[topic]=stringify(_line.substr(7));
+					flush();
+				}
 			}
 			_line.clear();
 		} else {
@@ -4,12 +4,15 @@
 #include <Log.h>
 #include <NanoAkka.h>
 #include <Mqtt.h>
+#include <map>
 
 class Neo6m : public Actor,public Source<MqttMessage> {
 		Connector* _connector;
 		UART& _uart;
 		static void onRxd(void*);
 		std::string _line;
+		std::map<std::string,std::string> _pending; // newest sentence per topic
+		void flush();
 	public:
 		Neo6m(Thread& thr,Connector* connector);
 		virtual ~Neo6m();
@@ -28,6 +28,7 @@
 static mcpwm_dev_t* MCPWM[2] = {&MCPWM0, &MCPWM1};
 
 void IRAM_ATTR RotaryEncoder::isrHandler(void* pv) { // ATTENTION !!! no float calculations in ISR
+	uint32_t isrEntry = isrMicros(); // Sys::micros() is not in IRAM
 	RotaryEncoder* re = (RotaryEncoder*)pv;
 	uint32_t mcpwm_intr_status;
 	// check encoder B when encoder A has isr,
@@ -42,7 +43,7 @@ void IRAM_ATTR RotaryEncoder::isrHandler(void* pv) { // ATTENTION !!! no float c
 	if(mcpwm_intr_status & CAP0_INT_EN) {
 		uint32_t capt = mcpwm_capture_signal_get_value(re->_mcpwm_num,MCPWM_SELECT_CAP0);
 		// get capture signal counter value
-		re->_rawCapture.on((capt-re->_prevCapture)* re->_direction);
+		re->_rawCapture.onFromIsr((capt-re->_prevCapture)* re->_direction,isrEntry);
 		re->_prevCapture = capt;
 	}
 	MCPWM[re->_mcpwm_num]->int_clr.val = mcpwm_intr_status;
@@ -52,11 +53,13 @@ RotaryEncoder::RotaryEncoder(Thread& thr,uint32_t pinTachoA, uint32_t pinTachoB)
 	: Actor(thr),
 	  _pinTachoA(pinTachoA)
 	, _dInTachoB(DigitalIn::create(pinTachoB))
+	,_rawCapture(thr)
 	,_captures(10)
 	,rpmMeasured(0),
 	  isrCounter([&]() {
 	return _isrCounter;
-}) {         // if no rpm measurement, suppose 0 as no capture
+}),
+	isrLatency(_rawCapture.latency(),99) {         // if no rpm measurement, suppose 0 as no capture
 	// bufer from ISR to user time
 	_captureDivider = CAPTURE_DIVIDER == 0 ? 1 : CAPTURE_DIVIDER * 2;
 	INFO(" capture Divider : %lu ",_captureDivider);
@@ -66,12 +69,11 @@ RotaryEncoder::RotaryEncoder(Thread& thr,uint32_t pinTachoA, uint32_t pinTachoB)
 	_mcpwm_num = MCPWM_UNIT_0;
 //	_timer_num = MCPWM_TIMER_0;
 
-	auto median = new Median<int32_t,5>();
-	auto captureToRpm = new LambdaFlow<int32_t,int32_t>([&](int32_t& rpm,const int32_t& capture) {
-		deltaToRpm(rpm,capture);
+	auto& captureToRpm = pipeline(MedianStage<int32_t,5>()	// get median , reduce noise
+	                              >> stage<int32_t,int32_t>([&](int32_t& rpm,const int32_t& capture) {
+		deltaToRpm(rpm,capture);	// convert to RPM
 		return 0;
-	});
-	auto throttle = new Throttle<int32_t>(100);
+	}) >> ThrottleStage<int32_t>(100));	// max 10 samples per sec
 	_timeoutFlow =  new TimeoutFlow<int32_t>(thread(),200,0);
 //	auto sink = new Sink<int32_t,10>();
 
@@ -79,9 +81,7 @@ RotaryEncoder::RotaryEncoder(Thread& thr,uint32_t pinTachoA, uint32_t pinTachoB)
 //	rpmMeasured >> sink;
 
 //	_rawCapture >> sink;
-	_rawCapture >> *median 				// get median , reduce noise
-	            >> *captureToRpm		// convert to RPM
-	            >> *throttle			// max 10 samples per sec
+	_rawCapture >> captureToRpm 		// fused median, rpm, throttle
 	            >> *_timeoutFlow			// non received eq 0
 	            >> rpmMeasured;	// emit async in another thread
 
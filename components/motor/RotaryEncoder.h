@@ -5,6 +5,7 @@
 #include <Log.h>
 #include <NanoAkka.h>
 #include <Filter.h>
+#include <Pipeline.h>
 //#include <coroutine.h>
 #include "driver/mcpwm.h"
 #include "driver/pcnt.h"
@@ -52,13 +53,14 @@ class RotaryEncoder : public Actor
 //		mcpwm_timer_t _timer_num;
     int32_t _samples[MAX_SAMPLES];
     uint32_t _indexSample = 0;
-    ValueFlow<int32_t> _rawCapture=0;
+    IsrSource<int32_t,16> _rawCapture; // ISR to thread, the chain runs there
     TimeoutFlow<int32_t> *_timeoutFlow;
     ValueFlow<int32_t> _captures=0;
 
 public:
     ValueFlow<int32_t> rpmMeasured =0;
     LambdaSource<uint32_t> isrCounter;
+    PercentileSource isrLatency; // p99 usec from capture ISR to thread
 
     RotaryEncoder(Thread& thr,uint32_t pinTachoA, uint32_t pinTachoB);
     ~RotaryEncoder();
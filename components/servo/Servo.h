@@ -3,7 +3,7 @@
 
 #include <Hardware.h>
 #include <NanoAkka.h>
-#include <MedianFilter.h>
+#include <Kernels.h>
 #include <BTS7960.h>
 #include <Device.h>
 
@@ -24,7 +24,7 @@ class Servo : public Device
 // D32 : ADC POT
     BTS7960 _bts7960;
     ADC& _adcPot;
-    MedianFilter<int,5> _potFilter;
+    FastMedian<int,5> _potFilter;
 
     mcpwm_unit_t _mcpwm_num;
     mcpwm_timer_t _timer_num;
@@ -3,7 +3,7 @@
 #include <ConfigFlow.h>
 #include <Device.h>
 #include <Hardware.h>
-#include <MedianFilter.h>
+#include <Kernels.h>
 #include <NanoAkka.h>
 #include <Pulser.h>
 
@@ -18,7 +18,7 @@ class StepperServo : public Actor, public Device {
   TimerSource _measureTimer;  // ADC multi sample and median
   TimerSource _controlTimer;  // PID loop interval
   TimerSource _reportTimer;   // report to MQTT
-  MedianFilter<int, 10> _potFilter;
+  FastMedian<int, 10> _potFilter;
   float _error = 0;
   float _errorPrior = 0;
 
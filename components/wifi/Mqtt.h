@@ -41,10 +41,13 @@ class ToMqtt : public LambdaFlow<T, MqttMessage> {
           JsonVariant variant = doc.to<JsonVariant>();
           variant.set(event);
           serializeJson(doc, s);
-          msg = {_name, s};
+          msg.topic = _name;
+          msg.message = std::move(s);
           return 0;
         }),
-        _name(name) {}
+        _name(name) {
+    this->cache(false);
+  }
   void request(){};
 };
 //_______________________________________________________________________________________________________________
@@ -111,7 +114,7 @@ class Mqtt : public Actor {
   ValueFlow<MqttBlock> blocks;
   ValueSource<bool> connected;
   TimerSource keepAliveTimer;
-  Mqtt(Thread &thr) : Actor(thr){};
+  Mqtt(Thread &thr) : Actor(thr) { incoming.cache(false); };
   ~Mqtt(){};
   void init();
   template <class T>
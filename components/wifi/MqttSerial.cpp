@@ -23,6 +23,7 @@ void MqttSerial::init() {
 	_loopbackTopic += "/system/loopback";
 	_loopbackReceived = 0;
 
+	_backlog.async(thread(),[&](const MqttMessage& m) { incoming.on(m); });
 	outgoing.async(thread(),[&](const MqttMessage& m) {
 		if ( connected()) {
 			std::string topic = _hostPrefix;
@@ -32,6 +33,8 @@ void MqttSerial::init() {
 	});
 
 	Sink<TimerMsg,3>& me = *this;
+	keepAliveTimer.slack(250); // share wakeups, the broker side waits seconds
+	connectTimer.slack(1000);
 	keepAliveTimer >> me;
 	connectTimer >> me;
 	_uart.setClock(115200);
@@ -45,7 +48,7 @@ void MqttSerial::on(const TimerMsg& tm) {
 		publish(_loopbackTopic, std::string("true"));
 		outgoing.on({"system/alive", "true"});
 	} else if(tm.id == TIMER_CONNECT) {
-		if(Sys::millis() > (_loopbackReceived + 2000)) {
+		if(Clock::millis() > (_loopbackReceived + 2000)) {
 			connected = false;
 			std::string topic;
 			string_format(topic, "dst/%s/#", Sys::hostname());
@@ -89,11 +92,17 @@ void MqttSerial::rxdSerial(std::string&  rxdString) {
 	JsonArray array = rxd.as<JsonArray>();
 	if(!array.isNull()) {
 		if(array[1].as<std::string>() == _loopbackTopic) {
-			_loopbackReceived = Sys::millis();
+			_loopbackReceived = Clock::millis();
 			connected = true;
 		} else {
 			std::string topic = array[1];
-			incoming.on({topic.substr(_hostPrefix.length()), array[2]});
+			MqttMessage msg = {topic.substr(_hostPrefix.length()), array[2]};
+			if(_backlog.credit()) { // the only producer : the push succeeds
+				_backlog.on(std::move(msg));
+			} else {
+				_backlogDropped++;
+				WARN(" rxd backlog full, dropped %s ", msg.topic.c_str());
+			}
 		}
 	} else {
 		WARN(" parsing JSON array failed ");
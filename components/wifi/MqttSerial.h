@@ -16,6 +16,7 @@
 #define TIMER_KEEP_ALIVE 1
 #define TIMER_CONNECT 2
 #define TIMER_SERIAL 3
+#define RXD_BACKLOG 10
 
 class MqttSerial : public Mqtt, public Sink<TimerMsg, 3> {
   StaticJsonDocument<3000> _jsonBuffer;
@@ -34,6 +35,11 @@ class MqttSerial : public Mqtt, public Sink<TimerMsg, 3> {
   NanoString _loopbackTopic;
   uint64_t _loopbackReceived;
   NanoString _hostPrefix;
+  // from the uart task to the thread, where incoming fans out : a slow
+  // subscriber drops in its own sink and holds up no other topic. Full :
+  // the new message is dropped and counted
+  Sink<MqttMessage, RXD_BACKLOG, QUEUE_SPSC> _backlog;
+  uint32_t _backlogDropped = 0;
 
   enum { CMD_SUBSCRIBE = 0, CMD_PUBLISH };
 
@@ -64,6 +70,7 @@ class MqttSerial : public Mqtt, public Sink<TimerMsg, 3> {
   void on(const TimerMsg &);
   void on(const MqttMessage &);
   void request();
+  uint32_t backlogDropped() const { return _backlogDropped; }
 };
 
 #endif  // MQTTSERIAL_H
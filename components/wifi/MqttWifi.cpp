@@ -56,6 +56,7 @@ void MqttWifi::init() {
   mqtt_cfg.keepalive = 20;  // to support OTA blocking
   _mqttClient = esp_mqtt_client_init(&mqtt_cfg);
 
+  _reportTimer.slack(250);
   _reportTimer.start();
 
   _reportTimer >>
@@ -76,6 +77,7 @@ void MqttWifi::init() {
   });
   keepAliveTimer.interval(1000);
   keepAliveTimer.repeat(true);
+  keepAliveTimer.slack(500);
   keepAliveTimer >> [&](const TimerMsg &tm) {
     INFO("");
     if (connected()) outgoing.on({_lwt_topic, "true"});
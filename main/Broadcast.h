@@ -0,0 +1,110 @@
+#ifndef BROADCAST_H
+#define BROADCAST_H
+#include <NanoAkka.h>
+#ifndef NO_ATOMIC
+//__________________________________________________________________________
+//
+// BroadcastFlow : fan-out of one producer to async consumers on other
+// threads, through one ring ( Disruptor style ). A value is copied once into
+// the ring, not once per consumer queue. Each reader keeps its own sequence
+// and hands the subscribers a reference into the ring, the slowest reader
+// gates the reuse of a slot.
+// - one producer : the source feeding it emits from one thread at a time
+// - readers are added before values flow
+// - a full ring drops the new value, sources that check demand() wait
+//
+//  BroadcastFlow<bool, 8> connected;
+//  mqtt.connected >> connected;
+//  connected.async(ledThread) >> led.blinkSlow;
+//  connected.async(mqttThread) >> poller.connected;
+//
+//__________________________________________________________________________
+template <class T, int N>
+class BroadcastFlow;
+
+template <class T, int N>
+class BroadcastReader final : public Source<T>, public Invoker {
+  friend class BroadcastFlow<T, N>;
+  BroadcastFlow<T, N> &_ring;
+  Dispatcher &_thread;
+  std::atomic<uint32_t> _sequence;  // next to read, read by the producer
+  char _padding[CACHE_LINE_SIZE];   // readers are on the heap : no alignas
+
+ public:
+  BroadcastReader(BroadcastFlow<T, N> &ring, Dispatcher &thread,
+                  uint32_t sequence)
+      : _ring(ring), _thread(thread), _sequence(sequence) {
+    this->cache(false);  // the values stay in the ring
+  }
+  // the slot is released after the subscribers returned
+  void invoke() {
+    uint32_t sequence = _sequence.load(std::memory_order_relaxed);
+    uint32_t cursor = _ring._cursor.load(std::memory_order_acquire);
+    while (sequence != cursor) {
+      this->emit(_ring._slots[sequence & (N - 1)]);
+      _sequence.store(++sequence, std::memory_order_release);
+    }
+  }
+  void request() {}  // emits what the producer publishes
+  uint32_t backlog() const {
+    return _ring._cursor.load(std::memory_order_relaxed) -
+           _sequence.load(std::memory_order_relaxed);
+  }
+};
+
+template <class T, int N>
+class BroadcastFlow : public Subscriber<T> {
+  static_assert(N && (N & (N - 1)) == 0, "BroadcastFlow : N power of 2");
+  friend class BroadcastReader<T, N>;
+  T _slots[N];
+  std::atomic<uint32_t> _cursor;  // next to write, published after the write
+  std::vector<BroadcastReader<T, N> *> _readers;
+  uint32_t _dropped = 0;
+
+  // the sequence the slowest reader is at, the producer's own when none
+  uint32_t gate(uint32_t cursor) {
+    uint32_t gate = cursor;
+    for (auto reader : _readers) {
+      uint32_t sequence = reader->_sequence.load(std::memory_order_acquire);
+      if ((int32_t)(sequence - gate) < 0) gate = sequence;
+    }
+    return gate;
+  }
+  template <class V>
+  void publish(V &&t) {
+    uint32_t cursor = _cursor.load(std::memory_order_relaxed);
+    if (cursor - gate(cursor) >= (uint32_t)N) {
+      _dropped++;
+      return;
+    }
+    _slots[cursor & (N - 1)] = std::forward<V>(t);
+    _cursor.store(cursor + 1, std::memory_order_release);
+    for (auto reader : _readers) reader->_thread.enqueue(reader);
+  }
+
+ public:
+  BroadcastFlow() : _cursor(0) {}
+  // the threads of the readers are stopped or done with it
+  ~BroadcastFlow() {
+    for (auto reader : _readers) delete reader;
+  }
+  // a reader whose subscribers run on thread, from the next value on
+  Source<T> &async(Dispatcher &thread, uint8_t priority = PRIORITY_NORMAL) {
+    BroadcastReader<T, N> *reader = new BroadcastReader<T, N>(
+        *this, thread, _cursor.load(std::memory_order_relaxed));
+    reader->priority(priority);
+    _readers.push_back(reader);
+    return *reader;
+  }
+  void on(const T &t) { publish(t); }
+  void on(T &&t) { publish(std::move(t)); }
+  uint32_t credit() {
+    uint32_t cursor = _cursor.load(std::memory_order_relaxed);
+    return N - (cursor - gate(cursor));
+  }
+  uint32_t dropped() const { return _dropped; }
+  uint32_t readers() const { return _readers.size(); }
+};
+
+#endif  // NO_ATOMIC
+#endif
@@ -1,15 +1,18 @@
+#ifndef FILTER_H
+#define FILTER_H
 #include <NanoAkka.h>
+#include <Kernels.h>
+
+#include <array>
 //__________________________________________________________________________`
 //
-// MedianFilter : calculates median of N samples
+// Median : median of the last x samples, see FastMedian in Kernels.h
 // it will only emit after enough samples
 // x : number of samples
 //
 //__________________________________________________________________________
-#include <MedianFilter.h>
-
 template <class T, int x> class Median : public Flow<T, T> {
-		MedianFilter<T, x> _mf;
+		FastMedian<T, x> _mf;
 
 	public:
 		Median() {};
@@ -36,10 +39,10 @@ template <class T> class Throttle : public Flow<T, T> {
 	public:
 		Throttle(uint32_t delta) {
 			_delta = delta;
-			_nextEmit = Sys::millis() + _delta;
+			_nextEmit = Clock::millis() + _delta;
 		}
 		void on(const T &value) {
-			uint64_t now = Sys::millis();
+			uint64_t now = Clock::millis();
 			if (now > _nextEmit) {
 				this->emit(value);
 				_nextEmit = now + _delta;
@@ -70,3 +73,215 @@ template <class T> class TimeoutFlow : public Flow<T, T> {
 		};
 		void request() { this->emit(_defaultValue); };
 };
+//__________________________________________________________________________`
+//
+// operators : small fixed size flows to compose sensor pipelines, none of
+// them allocates after construction
+//
+//  adc >> *new Filter<int>([](const int &v) { return v > 0; })
+//      >> *new DistinctUntilChanged<int>(5)  // ignore changes below 5
+//      >> *new Batch<int, 8>()               // one dispatch per 8 samples
+//      >> sink;
+//
+//__________________________________________________________________________
+//
+// Map : converts every value
+//
+template <class IN, class OUT> class Map : public Flow<IN, OUT> {
+		Delegate<OUT(const IN &)> _func;
+
+	public:
+		Map(Delegate<OUT(const IN &)> func) : _func(func) {}
+		void on(const IN &in) { this->emit(_func(in)); }
+		void request() {}
+};
+//
+// Filter : passes the values for which the predicate is true
+//
+template <class T> class Filter : public Flow<T, T> {
+		Delegate<bool(const T &)> _predicate;
+
+	public:
+		Filter(Delegate<bool(const T &)> predicate) : _predicate(predicate) {}
+		void on(const T &t) {
+			if (_predicate(t)) this->emit(t);
+		}
+		void request() {}
+};
+//
+// DistinctUntilChanged : passes a value that differs more than deadband
+// from the last one passed, deadband 0 : any change
+//
+template <class T> class DistinctUntilChanged : public Flow<T, T> {
+		T _deadband;
+		T _last;
+		bool _first = true;
+
+	public:
+		DistinctUntilChanged(T deadband = T()) : _deadband(deadband), _last() {}
+		void on(const T &t) {
+			T delta = t > _last ? t - _last : _last - t;
+			if (_first || delta > _deadband) {
+				_first = false;
+				_last = t;
+				this->emit(t);
+			}
+		}
+		void request() {
+			if (!_first) this->emit(_last);
+		}
+};
+//
+// Sample : emits the newest value once per period, nothing when no value
+// came in during the period
+//
+template <class T> class Sample : public Flow<T, T> {
+		T _last;
+		bool _fresh = false;
+		TimerSource _timer;
+
+	public:
+		Sample(Thread &thr, uint32_t period) : _last(), _timer(thr, 1, period, true) {
+			_timer >> ([&](const TimerMsg &tm) {
+				if (_fresh) {
+					_fresh = false;
+					this->emit(_last);
+				}
+			});
+		}
+		void on(const T &t) {
+			_last = t;
+			_fresh = true;
+		}
+		void request() { this->emit(_last); }
+};
+//
+// Debounce : emits the last value once no new value came for quiet msec
+//
+template <class T> class Debounce : public Flow<T, T> {
+		T _last;
+		TimerSource _timer;
+
+	public:
+		Debounce(Thread &thr, uint32_t quiet) : _last(), _timer(thr, 1, quiet, false) {
+			_timer >> ([&](const TimerMsg &tm) { this->emit(_last); });
+		}
+		void on(const T &t) {
+			_last = t;
+			_timer.start();
+		}
+		void request() { this->emit(_last); }
+};
+//
+// Window : reduces the last N values to one, oldest first
+// tumbling : an emit per N values, the window then starts empty
+// sliding : an emit per value once N values came in
+//
+template <class T, int N> class Window : public Flow<T, T> {
+		T _values[N];
+		uint32_t _count = 0;
+		bool _sliding;
+		Delegate<T(const T *, uint32_t)> _reduce;
+
+	public:
+		static T average(const T *values, uint32_t count) {
+			T sum = T();
+			for (uint32_t i = 0; i < count; i++) sum += values[i];
+			return sum / (T)count;
+		}
+		Window(bool sliding, Delegate<T(const T *, uint32_t)> reduce = average)
+			: _sliding(sliding), _reduce(reduce) {}
+		void on(const T &t) {
+			_values[_count++ % N] = t;
+			if (_count < N) return;
+			if (!_sliding) {
+				_count = 0;
+				this->emit(_reduce(_values, N));
+				return;
+			}
+			T ordered[N];  // the oldest sits at the next write position
+			for (uint32_t i = 0; i < N; i++) ordered[i] = _values[(_count + i) % N];
+			if (_count >= 2 * N) _count -= N;  // keeps the position, no overflow
+			this->emit(_reduce(ordered, N));
+		}
+		void request() {}
+};
+//
+// Batch : collects N values and emits them as one array, so the next stage
+// is dispatched once per N values
+//
+template <class T, int N> class Batch : public Flow<T, std::array<T, N>> {
+		std::array<T, N> _batch;
+		uint32_t _count = 0;
+
+	public:
+		void on(const T &t) {
+			_batch[_count++] = t;
+			if (_count == N) {
+				_count = 0;
+				this->emit(_batch);
+			}
+		}
+		void request() {}
+};
+//
+// Scan : folds every value into an accumulator and emits it, for running
+// sums or averages
+//
+//  Scan<int, int> smooth(0, [](const int &avg, const int &v) { return avg + (v - avg) / 2; });
+//
+template <class T, class ACC> class Scan : public Flow<T, ACC> {
+		ACC _acc;
+		Delegate<ACC(const ACC &, const T &)> _func;
+
+	public:
+		Scan(ACC initial, Delegate<ACC(const ACC &, const T &)> func)
+			: _acc(initial), _func(func) {}
+		void on(const T &t) {
+			_acc = _func(_acc, t);
+			this->emit(_acc);
+		}
+		void request() { this->emit(_acc); }
+};
+//
+// Merge : one stream of the values of all sources subscribed to it
+//
+template <class T> class Merge : public Flow<T, T> {
+	public:
+		void on(const T &t) { this->emit(t); }
+		void request() {}
+};
+//
+// CombineLatest : combines the newest values of two sources on every value
+// of either, once both delivered one
+//
+//  CombineLatest<int, int, int> sum([](const int &a, const int &b) { return a + b; });
+//  x >> sum.first;
+//  y >> sum.second;
+//
+template <class A, class B, class OUT> class CombineLatest : public Source<OUT> {
+		template <class T> class Input : public Subscriber<T> {
+				CombineLatest &_combine;
+
+			public:
+				T value;
+				bool valid = false;
+				Input(CombineLatest &combine) : _combine(combine), value() {}
+				void on(const T &t) {
+					value = t;
+					valid = true;
+					_combine.request();
+				}
+		};
+		Delegate<OUT(const A &, const B &)> _func;
+
+	public:
+		Input<A> first;
+		Input<B> second;
+		CombineLatest(Delegate<OUT(const A &, const B &)> func)
+			: _func(func), first(*this), second(*this) {}
+		void request() {
+			if (first.valid && second.valid) this->emit(_func(first.value, second.value));
+		}
+};
+#endif
@@ -0,0 +1,336 @@
+#ifndef KERNELS_H
+#define KERNELS_H
+#include <stdint.h>
+#include <string.h>
+#include <type_traits>
+//__________________________________________________________________________
+//
+// Kernels : per sample filter arithmetic without allocation
+// - sorting network medians for a fixed window, no branches on the data
+// - a sliding median in O(log N) per sample for larger windows
+// - running mean, variance, min and max over a window
+//
+// The networks are written for a value type V that is either a scalar or a
+// GCC vector : on the host medianChannels() runs 4 channels per vector, on
+// the device the same code is plain integer min/max.
+//
+//  FastMedian<int, 5> pot;       // drop-in for MedianFilter<int, 5>
+//  pot.addSample(adc);
+//  if (pot.isReady()) angle = pot.getMedian();
+//
+//__________________________________________________________________________
+//
+// compare exchange : a gets the smaller, b the larger. The ternaries
+// compile to conditional moves or MIN/MAX, per lane on vector types.
+//
+template <class V>
+inline void sortPair(V &a, V &b) {
+  V lo = a < b ? a : b;
+  V hi = a < b ? b : a;
+  a = lo;
+  b = hi;
+}
+//
+// median of N values, p is overwritten. The optimal networks for 3, 5, 7
+// and 9 ( Paeth, Devillard ), odd-even transposition for the other sizes.
+// Even N : the upper of the two middle values.
+//
+template <class V, int N>
+struct MedianNetwork {
+  static inline V median(V *p) {
+    for (int round = 0; round < N; round++)
+      for (int i = round & 1; i + 1 < N; i += 2) sortPair(p[i], p[i + 1]);
+    return p[N / 2];
+  }
+};
+
+template <class V>
+struct MedianNetwork<V, 1> {
+  static inline V median(V *p) { return p[0]; }
+};
+
+template <class V>
+struct MedianNetwork<V, 3> {
+  static inline V median(V *p) {
+    sortPair(p[0], p[1]);
+    sortPair(p[1], p[2]);
+    sortPair(p[0], p[1]);
+    return p[1];
+  }
+};
+
+template <class V>
+struct MedianNetwork<V, 5> {
+  static inline V median(V *p) {
+    sortPair(p[0], p[1]);
+    sortPair(p[3], p[4]);
+    sortPair(p[0], p[3]);
+    sortPair(p[1], p[4]);
+    sortPair(p[1], p[2]);
+    sortPair(p[2], p[3]);
+    sortPair(p[1], p[2]);
+    return p[2];
+  }
+};
+
+template <class V>
+struct MedianNetwork<V, 7> {
+  static inline V median(V *p) {
+    sortPair(p[0], p[5]);
+    sortPair(p[0], p[3]);
+    sortPair(p[1], p[6]);
+    sortPair(p[2], p[4]);
+    sortPair(p[0], p[1]);
+    sortPair(p[3], p[5]);
+    sortPair(p[2], p[6]);
+    sortPair(p[2], p[3]);
+    sortPair(p[3], p[6]);
+    sortPair(p[4], p[5]);
+    sortPair(p[1], p[4]);
+    sortPair(p[1], p[3]);
+    sortPair(p[3], p[4]);
+    return p[3];
+  }
+};
+
+template <class V>
+struct MedianNetwork<V, 9> {
+  static inline V median(V *p) {
+    sortPair(p[1], p[2]);
+    sortPair(p[4], p[5]);
+    sortPair(p[7], p[8]);
+    sortPair(p[0], p[1]);
+    sortPair(p[3], p[4]);
+    sortPair(p[6], p[7]);
+    sortPair(p[1], p[2]);
+    sortPair(p[4], p[5]);
+    sortPair(p[7], p[8]);
+    sortPair(p[0], p[3]);
+    sortPair(p[5], p[8]);
+    sortPair(p[4], p[7]);
+    sortPair(p[3], p[6]);
+    sortPair(p[1], p[4]);
+    sortPair(p[2], p[5]);
+    sortPair(p[4], p[7]);
+    sortPair(p[4], p[2]);
+    sortPair(p[6], p[4]);
+    sortPair(p[4], p[2]);
+    return p[4];
+  }
+};
+//
+// medians of several channels at once, samples[i * channels + c] is sample
+// i of channel c. On the host 4 channels share a vector.
+//
+#if defined(LINUX) && defined(__GNUC__)
+#define KERNEL_LANES 4
+typedef int32_t Int32Lanes __attribute__((vector_size(4 * KERNEL_LANES)));
+#else
+#define KERNEL_LANES 1
+#endif
+
+template <int N>
+void medianChannels(const int32_t *samples, int32_t *medians,
+                    uint32_t channels) {
+  uint32_t c = 0;
+#if KERNEL_LANES > 1
+  for (; c + KERNEL_LANES <= channels; c += KERNEL_LANES) {
+    Int32Lanes window[N];
+    for (int i = 0; i < N; i++)
+      memcpy(&window[i], samples + i * channels + c, sizeof(Int32Lanes));
+    Int32Lanes median = MedianNetwork<Int32Lanes, N>::median(window);
+    memcpy(medians + c, &median, sizeof(Int32Lanes));
+  }
+#endif
+  for (; c < channels; c++) {
+    int32_t window[N];
+    for (int i = 0; i < N; i++) window[i] = samples[i * channels + c];
+    medians[c] = MedianNetwork<int32_t, N>::median(window);
+  }
+}
+//__________________________________________________________________________
+//
+// NetworkMedian : median of the last N samples by sorting network, for
+// small N. Until N samples came in the empty places hold the first sample.
+//
+template <class T, int N>
+class NetworkMedian {
+  T _samples[N];
+  uint32_t _index = 0;
+  uint32_t _count = 0;
+
+ public:
+  void addSample(T t) {
+    if (_count == 0)
+      for (int i = 0; i < N; i++) _samples[i] = t;
+    _samples[_index] = t;
+    _index = (_index + 1) % N;
+    if (_count < N) _count++;
+  }
+  bool isReady() { return _count >= N; }
+  T getMedian() {
+    T window[N];
+    for (int i = 0; i < N; i++) window[i] = _samples[i];
+    return MedianNetwork<T, N>::median(window);
+  }
+};
+//__________________________________________________________________________
+//
+// SlidingMedian : median of the last N samples in O(log N) per sample, a
+// max-heap below and a min-heap above the median in one array, indexed
+// from the median ( the "mediator" of A. Shelly ). For larger windows.
+// Even N : the upper of the two middle values.
+//
+template <class T, int N>
+class SlidingMedian {
+  T _data[N];         // ring of samples
+  int _pos[N];        // heap index of each sample
+  int _storage[N];    // sample indexes, max-heap < 0, median 0, min-heap > 0
+  int *_heap;         // the median in the middle of _storage
+  int _idx = 0;       // next in the ring
+  int _count = 0;
+
+  inline int minCount() { return (_count - 1) / 2; }
+  inline int maxCount() { return _count / 2; }
+  inline bool less(int i, int j) {
+    return _data[_heap[i]] < _data[_heap[j]];
+  }
+  bool exchange(int i, int j) {
+    int t = _heap[i];
+    _heap[i] = _heap[j];
+    _heap[j] = t;
+    _pos[_heap[i]] = i;
+    _pos[_heap[j]] = j;
+    return true;
+  }
+  inline bool compareExchange(int i, int j) { return less(i, j) && exchange(i, j); }
+  // from node i down, i against its parent first
+  void minSortDown(int i) {
+    for (; i <= minCount(); i *= 2) {
+      if (i > 1 && i < minCount() && less(i + 1, i)) ++i;
+      if (!compareExchange(i, i / 2)) break;
+    }
+  }
+  void maxSortDown(int i) {
+    for (; i >= -maxCount(); i *= 2) {
+      if (i < -1 && i > -maxCount() && less(i, i - 1)) --i;
+      if (!compareExchange(i / 2, i)) break;
+    }
+  }
+  // true when the item reached the median
+  bool minSortUp(int i) {
+    while (i > 0 && compareExchange(i, i / 2)) i /= 2;
+    return i == 0;
+  }
+  bool maxSortUp(int i) {
+    while (i < 0 && compareExchange(i / 2, i)) i /= 2;
+    return i == 0;
+  }
+
+ public:
+  SlidingMedian(const SlidingMedian &) = delete;  // _heap points inside
+  SlidingMedian() {
+    _heap = _storage + N / 2;
+    for (int i = N - 1; i >= 0; i--) {  // fill : median, max, min, max ..
+      _pos[i] = ((i + 1) / 2) * ((i & 1) ? -1 : 1);
+      _heap[_pos[i]] = i;
+    }
+  }
+  void addSample(T t) {
+    bool isNew = _count < N;
+    int p = _pos[_idx];
+    T old = _data[_idx];
+    _data[_idx] = t;
+    _idx = (_idx + 1) % N;
+    _count += isNew;
+    if (p > 0) {  // in the min-heap
+      if (!isNew && old < t)
+        minSortDown(p * 2);
+      else if (minSortUp(p))
+        maxSortDown(-1);
+    } else if (p < 0) {  // in the max-heap
+      if (!isNew && t < old)
+        maxSortDown(p * 2);
+      else if (maxSortUp(p))
+        minSortDown(1);
+    } else {  // at the median
+      if (maxCount()) maxSortDown(-1);
+      if (minCount()) minSortDown(1);
+    }
+  }
+  bool isReady() { return _count >= N; }
+  T getMedian() { return _data[_heap[0]]; }
+};
+//
+// networks up to 16 samples, the heaps above
+//
+#define MEDIAN_NETWORK_MAX 16
+template <class T, int N>
+using FastMedian =
+    typename std::conditional<(N <= MEDIAN_NETWORK_MAX), NetworkMedian<T, N>,
+                              SlidingMedian<T, N>>::type;
+//__________________________________________________________________________
+//
+// RunningStats : mean, variance, min and max of the last N samples, O(1)
+// per sample. Sums are 64 bit integers for integer samples. min and max
+// come from a queue of candidates that only holds increasing ( min ) or
+// decreasing ( max ) values.
+//
+template <class T, int N>
+class RunningStats {
+  typedef typename std::conditional<std::is_integral<T>::value, int64_t,
+                                    double>::type Sum;
+  T _samples[N];
+  uint32_t _seq = 0;  // samples added, the index of the next
+  Sum _sum = 0;
+  Sum _sumSquares = 0;
+  uint32_t _minQueue[N];  // ring slots, oldest at the head
+  uint32_t _maxQueue[N];
+  uint32_t _minHead = 0, _minSize = 0;
+  uint32_t _maxHead = 0, _maxSize = 0;
+
+  template <class BETTER>
+  void enter(uint32_t *queue, uint32_t &head, uint32_t &size, T t,
+             BETTER better) {
+    uint32_t slot = _seq % N;
+    if (size && _seq >= N && queue[head] == slot) {  // leaves the window
+      head = (head + 1) % N;
+      size--;
+    }
+    while (size && !better(_samples[queue[(head + size - 1) % N]], t)) size--;
+    queue[(head + size) % N] = slot;
+    size++;
+  }
+
+ public:
+  void add(T t) {
+    if (_seq >= N) {
+      T old = _samples[_seq % N];
+      _sum -= old;
+      _sumSquares -= (Sum)old * old;
+    }
+    enter(_minQueue, _minHead, _minSize, t,
+          [](const T &a, const T &b) { return a < b; });
+    enter(_maxQueue, _maxHead, _maxSize, t,
+          [](const T &a, const T &b) { return a > b; });
+    _samples[_seq % N] = t;
+    _sum += t;
+    _sumSquares += (Sum)t * t;
+    _seq++;
+    if (_seq == 2 * N) _seq = N;  // same slots, no overflow
+  }
+  uint32_t count() const { return _seq < N ? _seq : N; }
+  bool isReady() const { return _seq >= N; }
+  float mean() const { return count() ? (float)_sum / count() : 0; }
+  float variance() const {
+    uint32_t n = count();
+    if (n == 0) return 0;
+    float mean = (float)_sum / n;
+    float variance = (float)_sumSquares / n - mean * mean;
+    return variance > 0 ? variance : 0;
+  }
+  T min() const { return _samples[_minQueue[_minHead]]; }
+  T max() const { return _samples[_maxQueue[_maxHead]]; }
+};
+
+#endif
@@ -0,0 +1,137 @@
+#include "MicroTimer.h"
+#if defined(ESP32_IDF) || defined(LINUX)
+#ifdef LINUX
+#include <sys/timerfd.h>
+#include <unistd.h>
+#endif
+/*
+ __  __ _               _____ _
+|  \/  (_) ___ _ __ ___|_   _(_)_ __ ___   ___ _ __
+| |\/| | |/ __| '__/ _ \ | | | | '_ ` _ \ / _ \ '__|
+| |  | | | (__| | | (_) || | | | | | | | |  __/ |
+|_|  |_|_|\___|_|  \___/ |_| |_|_| |_| |_|\___|_|
+*/
+MicroTimerSource::MicroTimerSource(Thread& thr, uint32_t id, uint32_t intervalUsec, bool repeat)
+    : _thread(thr), _id(id), _interval(intervalUsec), _repeat(repeat), _expireTime(0), _due(0)
+{
+    priority(PRIORITY_HIGH);
+}
+#if defined(ESP32_IDF)
+//
+// esp_timer runs the callback in its own high priority task, the timer
+// is created on the first start() : esp_timer is not up yet for static
+// constructors
+//
+void MicroTimerSource::arm()
+{
+    if (_timer == 0) {
+        esp_timer_create_args_t args = {};
+        args.callback = [](void* timer) {
+            ((MicroTimerSource*)timer)->expired();
+        };
+        args.arg = this;
+        args.dispatch_method = ESP_TIMER_TASK;
+        args.name = "microTimer";
+        if (esp_timer_create(&args, &_timer) != ESP_OK) {
+            WARN("esp_timer_create() failed.");
+            _timer = 0;
+            return;
+        }
+    }
+    uint64_t now = Sys::micros();
+    uint64_t expireTime = _expireTime;
+    esp_timer_stop(_timer); // not running is fine
+    esp_timer_start_once(_timer, expireTime > now ? expireTime - now : 0);
+}
+
+void MicroTimerSource::disarm()
+{
+    _running = false;
+    if (_timer) esp_timer_stop(_timer);
+}
+
+MicroTimerSource::~MicroTimerSource()
+{
+    disarm();
+    if (_timer) esp_timer_delete(_timer);
+}
+#elif defined(LINUX)
+//
+// a timerfd on CLOCK_MONOTONIC, read by a helper thread that plays the
+// part of the esp_timer task
+//
+void MicroTimerSource::arm()
+{
+    if (_fd < 0) {
+        _fd = timerfd_create(CLOCK_MONOTONIC, TFD_CLOEXEC);
+        if (_fd < 0) {
+            WARN("timerfd_create() failed : %d", errno);
+            return;
+        }
+        _reader = std::thread([this]() {
+            pthread_setname_np(pthread_self(), "microTimer");
+            uint64_t expirations;
+            while (read(_fd, &expirations, sizeof(expirations)) == sizeof(expirations)) {
+                if (_closing) return;
+                expired();
+            }
+        });
+    }
+    uint64_t now = Sys::micros();
+    uint64_t expireTime = _expireTime;
+    uint64_t delay = expireTime > now ? expireTime - now : 1; // 0 disarms
+    struct itimerspec its = {};
+    its.it_value.tv_sec = delay / 1000000;
+    its.it_value.tv_nsec = (delay % 1000000) * 1000;
+    timerfd_settime(_fd, 0, &its, 0);
+}
+
+void MicroTimerSource::disarm()
+{
+    _running = false;
+    struct itimerspec its = {};
+    if (_fd >= 0) timerfd_settime(_fd, 0, &its, 0);
+}
+// a last expiry wakes the reader out of its read, a close would not
+MicroTimerSource::~MicroTimerSource()
+{
+    disarm();
+    if (_fd < 0) return;
+    _closing = true;
+    struct itimerspec its = {};
+    its.it_value.tv_nsec = 1;
+    timerfd_settime(_fd, 0, &its, 0);
+    _reader.join();
+    close(_fd);
+}
+#endif
+
+void MicroTimerSource::start()
+{
+    _running = true;
+    _expireTime = Sys::micros() + _interval;
+    arm();
+}
+// the next expiry is armed before the thread gets to run, a slow thread
+// coalesces expiries into one emit instead of delaying the period
+void MicroTimerSource::expired()
+{
+    if (!_running) return; // stop() raced the expiry
+    _due = (uint32_t)_expireTime.load();
+    _fired++;
+    if (_repeat) {
+        setNewExpireTime(Sys::micros());
+        arm();
+    } else {
+        _running = false;
+    }
+    _thread.enqueue(this);
+}
+
+void MicroTimerSource::invoke()
+{
+    _jitter.add((uint32_t)Sys::micros() - _due);
+    TimerMsg tm = {_id};
+    emit(tm);
+}
+#endif
@@ -0,0 +1,75 @@
+#ifndef MICROTIMER_H
+#define MICROTIMER_H
+#include <NanoAkka.h>
+#if defined(ESP32_IDF) || defined(LINUX)
+#ifdef ESP32_IDF
+#include "esp_timer.h"
+#endif
+//__________________________________________________________________________
+//
+// MicroTimerSource : a TimerSource with a usec interval for fast control
+// loops, not quantized to the RTOS tick. The expiry comes from esp_timer on
+// ESP32 and from a timerfd on Linux. The TimerMsg is emitted on the owning
+// thread, in its high priority lane.
+//
+// drift : a repeating timer keeps its period, when it is more than a
+// period late it skips the missed ones ( as TimerSource does )
+// jitter : usec between the expiry and the emit on the thread
+//
+//  MicroTimerSource control(thisThread, 3, 2000, true);  // 500 Hz
+//  control >> [&](const TimerMsg &) { pid(); };
+//__________________________________________________________________________
+class MicroTimerSource final : public Source<TimerMsg>, public Invoker {
+  Thread &_thread;
+  uint32_t _id;
+  uint32_t _interval;  // usec
+  bool _repeat;
+  volatile bool _running = false;
+  // usec, Sys::micros(). Written by start() and by the timer context : 64
+  // bits tear on the 32 bit target without the atomic
+  std::atomic<uint64_t> _expireTime;
+  std::atomic<uint32_t> _due;  // low 32 bits of the expiry being handled
+  uint32_t _fired = 0;
+  uint32_t _missed = 0;
+  Histogram _jitter;
+#ifdef ESP32_IDF
+  esp_timer_handle_t _timer = 0;
+#else
+  int _fd = -1;
+  std::thread _reader;  // blocks on the timerfd
+  std::atomic<bool> _closing{false};
+#endif
+  void setNewExpireTime(uint64_t now) {
+    uint64_t expireTime = _expireTime.load() + _interval;
+    if (expireTime < now) {
+      _missed++;
+      expireTime = now + _interval;
+    }
+    _expireTime = expireTime;
+  }
+  void arm();
+  void disarm();
+  void expired();  // timer context
+
+ public:
+  MicroTimerSource(Thread &thr, uint32_t id, uint32_t intervalUsec,
+                   bool repeat);
+  // disarms and releases the timer, the thread should not have it queued
+  ~MicroTimerSource();
+  void start();
+  void start(uint32_t intervalUsec) {
+    _interval = intervalUsec;
+    start();
+  }
+  void stop() { disarm(); }
+  void interval(uint32_t intervalUsec) { _interval = intervalUsec; }
+  inline uint32_t interval() { return _interval; }
+  void request() {}  // emits on expiry only
+  void invoke();
+  const Histogram &jitter() const { return _jitter; }
+  uint32_t fired() const { return _fired; }    // expiries, some coalesced
+  uint32_t missed() const { return _missed; }  // periods skipped
+};
+
+#endif
+#endif
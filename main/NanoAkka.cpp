@@ -1,5 +1,7 @@
 #include "NanoAkka.h"
 
+#include <algorithm>
+
 NanoStats stats;
 /*
  _____ _                        _
@@ -9,87 +11,544 @@ NanoStats stats;
   |_| |_| |_|_|  \___|\__,_|\__,_|
 */
 int Thread::_id=0;
+bool Clock::_simulated=false;
+uint64_t Clock::_virtualUsec=0;
 
+#if defined(FREERTOS) && defined(NO_ATOMIC)
+//
+// a kernel queue per lane, the task blocks on the normal lane. A high lane
+// enqueue also sends a null invoker there to wake it.
+//
+#define NORMAL_LANE (THREAD_LANES - 1)
 void Thread::createQueue()
 {
-    _workQueue = xQueueCreate(20, sizeof(Invoker *));
-    if ( _workQueue== NULL) WARN("Queue creation failed ");
+    for (uint32_t lane = 0; lane < THREAD_LANES; lane++) {
+        _workQueue[lane] = xQueueCreate(20, sizeof(Invoker *));
+        if ( _workQueue[lane]== NULL) WARN("Queue creation failed ");
+    }
 }
 
 void Thread::start()
 {
+    _stop = false;
+    _running = true;
     xTaskCreate([](void* task) {
         ((Thread*)task)->run();
-    }, _name.c_str(), 20000, this, tskIDLE_PRIORITY, NULL);
-    /*
-    	xTaskCreatePinnedToCore([](void* task) {
-    		((Thread*)task)->run();
-    	}, _name.c_str(), 20000, this, 17, NULL, PRO_CPU);*/
+        vTaskDelete(NULL);
+    }, _name.c_str(), _stackSize, this, _priority, &_task);
+}
+
+uint32_t Thread::stackFree()
+{
+    return _task ? uxTaskGetStackHighWaterMark(_task) : 0;
+}
+
+void Thread::wake()
+{
+    Invoker* wake = 0;
+    xQueueSend(_workQueue[NORMAL_LANE], &wake, (TickType_t)0);
 }
 
 int Thread::enqueue(Invoker* invoker)
 {
 //	INFO("Thread '%s' >>> '%s'",_name.c_str(),symbols(invoker));
-    if (_workQueue)
-        if (xQueueSend(_workQueue, &invoker, (TickType_t)0) != pdTRUE) {
+    if (!invoker->schedule()) return 0; // already pending
+    invoker->_enqueueTime = Sys::micros();
+    QueueHandle_t queue = _workQueue[invoker->_priority];
+    if (queue) {
+        if (xQueueSend(queue, &invoker, (TickType_t)0) != pdTRUE) {
+            invoker->unschedule();
             stats.threadQueueOverflow++;
             WARN("Thread '%s' queue overflow [%X]",_name.c_str(),invoker);
             return ENOBUFS;
         }
+        queued();
+    }
+    if (invoker->_priority != NORMAL_LANE) {
+        Invoker* wake = 0; // a full normal lane wakes the task as well
+        xQueueSend(_workQueue[NORMAL_LANE], &wake, (TickType_t)0);
+    }
     return 0;
 };
-int Thread::enqueueFromIsr(Invoker* invoker)
+int IRAM_ATTR Thread::enqueueFromIsr(Invoker* invoker)
 {
-    if (_workQueue) {
-        if (xQueueSendFromISR(_workQueue, &invoker, (TickType_t)0) != pdTRUE) {
+    if (!invoker->schedule()) return 0;
+    invoker->_enqueueTime = isrMicros();
+    QueueHandle_t queue = _workQueue[invoker->_priority];
+    if (queue) {
+        if (xQueueSendFromISR(queue, &invoker, (TickType_t)0) != pdTRUE) {
             //  WARN("queue overflow"); // cannot log here concurency issue
+            invoker->unschedule();
             stats.threadQueueOverflow++;
             return ENOBUFS;
         }
+        queued();
+    }
+    if (invoker->_priority != NORMAL_LANE) {
+        Invoker* wake = 0;
+        xQueueSendFromISR(_workQueue[NORMAL_LANE], &wake, (TickType_t)0);
     }
     return 0;
 };
 
-void Thread::run()
+bool Thread::receive(Invoker*& invoker,uint32_t waitUsec)
 {
-    INFO("Thread '%s' started ",_name.c_str());
-    uint32_t noWaits=0;
+    TickType_t tickWaits  = pdMS_TO_TICKS(waitUsec / 1000) ;
+    while (true) {
+        for (uint32_t lane = 0; lane < NORMAL_LANE; lane++)
+            if (xQueueReceive(_workQueue[lane], &invoker, 0) == pdTRUE) return true;
+        if (xQueueReceive(_workQueue[NORMAL_LANE], &invoker, tickWaits) != pdTRUE) return false;
+        if (invoker) return true;
+        tickWaits = 0; // woken for a higher lane
+    }
+}
+#elif defined(FREERTOS)
+//
+// the work queue is an intrusive list of invokers, the task is woken with a
+// direct task notification : no kernel queue copy and no overflow
+//
+void Thread::createQueue() {}
+
+Invoker* Thread::pop()
+{
+    for (uint32_t lane = 0; lane < THREAD_LANES; lane++) {
+        Invoker* invoker = _workQueue[lane].pop();
+        if ( invoker ) return invoker;
+    }
+    return 0;
+}
+
+void Thread::start()
+{
+    _stop = false;
+    _running = true;
+#ifdef ESP32_IDF
+    xTaskCreatePinnedToCore([](void* task) {
+        ((Thread*)task)->run();
+        vTaskDelete(NULL);
+    }, _name.c_str(), _stackSize, this, _priority, &_task,
+    _core == THREAD_ANY_CORE ? tskNO_AFFINITY : _core);
+#else
+    xTaskCreate([](void* task) {
+        ((Thread*)task)->run();
+        vTaskDelete(NULL);
+    }, _name.c_str(), _stackSize, this, _priority, &_task);
+#endif
+}
+
+uint32_t Thread::stackFree()
+{
+    return _task ? uxTaskGetStackHighWaterMark(_task) : 0;
+}
+
+void Thread::wake()
+{
+    if (_task) xTaskNotifyGive(_task);
+}
+
+int Thread::enqueue(Invoker* invoker)
+{
+    if (!invoker->schedule()) return 0; // already pending
+    invoker->_enqueueTime = Sys::micros();
+    _workQueue[invoker->_priority].push(invoker);
+    queued();
+    if (_task) xTaskNotifyGive(_task);
+    return 0;
+};
+
+int IRAM_ATTR Thread::enqueueFromIsr(Invoker* invoker)
+{
+    if (!invoker->schedule()) return 0;
+    invoker->_enqueueTime = isrMicros();
+    _workQueue[invoker->_priority].push(invoker);
+    queued();
+    if (_task) {
+        BaseType_t higherPriorityTaskWoken = pdFALSE;
+        vTaskNotifyGiveFromISR(_task, &higherPriorityTaskWoken);
+        if (higherPriorityTaskWoken) portYIELD_FROM_ISR();
+    }
+    return 0;
+};
+
+bool Thread::receive(Invoker*& invoker,uint32_t waitUsec)
+{
+    invoker = pop();
+    if ( invoker ) return true;
+    TickType_t tickWaits  = pdMS_TO_TICKS(waitUsec / 1000) ;
+    if ( tickWaits==0 ) return false;
+    ulTaskNotifyTake(pdTRUE, tickWaits);
+    invoker = pop();
+    return invoker != 0;
+}
+#elif defined(LINUX)
+//
+// the work queue is an intrusive list of invokers, the thread blocks on a
+// condition variable until an enqueue or the nearest timer deadline. There
+// are no interrupts on a host, a signal handler should not use
+// enqueueFromIsr.
+//
+void Thread::createQueue() {}
+
+Invoker* Thread::pop()
+{
+    for (uint32_t lane = 0; lane < THREAD_LANES; lane++) {
+        Invoker* invoker = _workQueue[lane].pop();
+        if ( invoker ) return invoker;
+    }
+    return 0;
+}
+
+// a pthread for the stack size and affinity attributes, the priority is
+// left to the host scheduler : SCHED_OTHER threads don't have one
+void Thread::start()
+{
+    _stop = false;
+    _running = true;
+    pthread_attr_t attr;
+    pthread_attr_init(&attr);
+    pthread_attr_setdetachstate(&attr, PTHREAD_CREATE_DETACHED);
+    if ( _stackSize ) pthread_attr_setstacksize(&attr, std::max(_stackSize, (uint32_t)PTHREAD_STACK_MIN));
+    if ( _core != THREAD_ANY_CORE ) {
+        cpu_set_t cpus;
+        CPU_ZERO(&cpus);
+        CPU_SET(_core, &cpus);
+        pthread_attr_setaffinity_np(&attr, sizeof(cpus), &cpus);
+    }
+    pthread_t thr;
+    int rc = pthread_create(&thr, &attr, [](void* thread) -> void* {
+        // by the thread itself, a detached thr may be gone after create
+        pthread_setname_np(pthread_self(), ((Thread*)thread)->_name.substr(0, 15).c_str());
+        ((Thread*)thread)->run();
+        return 0;
+    }, this);
+    pthread_attr_destroy(&attr);
+    if ( rc ) {
+        WARN("Thread '%s' create failed : %d ",_name.c_str(),rc);
+        _running = false;
+        return;
+    }
+}
+
+uint32_t Thread::stackFree()
+{
+    return 0;
+}
+
+void Thread::wake()
+{
+    {
+        std::lock_guard<std::mutex> lock(_mutex);
+    }
+    _wakeup.notify_one();
+}
+
+int Thread::enqueue(Invoker* invoker)
+{
+    if (!invoker->schedule()) return 0; // already pending
+    invoker->_enqueueTime = Sys::micros();
+    _workQueue[invoker->_priority].push(invoker);
+    queued();
+    wake(); // the lock : no lost wakeup between test and wait
+    return 0;
+};
+
+int IRAM_ATTR Thread::enqueueFromIsr(Invoker* invoker)
+{
+    return enqueue(invoker);
+};
+
+bool Thread::receive(Invoker*& invoker,uint32_t waitUsec)
+{
+    invoker = pop();
+    if ( invoker || waitUsec==0 ) return invoker != 0;
+    std::unique_lock<std::mutex> lock(_mutex);
+    _wakeup.wait_for(lock, std::chrono::microseconds(waitUsec), [&]() {
+        invoker = pop();
+        return invoker != 0 || _stop;
+    });
+    return invoker != 0;
+}
+#endif
+
+#ifdef FREERTOS
+#define TICK_USEC (portTICK_PERIOD_MS * 1000)
+#define THREAD_YIELD() taskYIELD()
+#elif defined(LINUX)
+#define TICK_USEC 1
+#define THREAD_YIELD() std::this_thread::yield()
+#else
+#define TICK_USEC 1000
+#define THREAD_YIELD()
+#endif
+//
+// wait for an invoker until deadline ( usec ), following the wait strategy.
+// The kernel only blocks for whole ticks : what is left below a tick is spun
+// or, for WAIT_BLOCK, rounded up to a tick.
+//
+bool Thread::waitFor(Invoker*& invoker,uint64_t deadline)
+{
+    if ( receive(invoker,0) ) return true;
+    uint64_t start = Sys::micros();
+    uint64_t spinEnd = start;
+    if ( _waitStrategy == WAIT_YIELD_SPIN ) spinEnd = deadline;
+    else if ( _waitStrategy == WAIT_SPIN_THEN_BLOCK ) spinEnd = std::min(deadline, start + _spinUsec);
+    while (true) {
+        uint64_t now = Sys::micros();
+        if ( now >= deadline || _stop ) return false;
+        uint64_t remaining = deadline - now;
+        if ( now < spinEnd ) {
+            if ( _waitStrategy == WAIT_YIELD_SPIN ) THREAD_YIELD();
+            if ( receive(invoker,0) ) break;
+        } else if ( remaining >= TICK_USEC ) {
+            if ( receive(invoker,remaining) ) break;
+        } else if ( _waitStrategy == WAIT_BLOCK ) { // late rather than a busy loop
+            if ( receive(invoker,TICK_USEC) ) break;
+            return false;
+        } else if ( receive(invoker,0) ) break;
+    }
+    _wakeLatency.add(Sys::micros() - invoker->_enqueueTime);
+    return true;
+}
+
+//
+// timers are kept in a min-heap on their armed deadline. A timer that moves
+// to a later time stays in place until it reaches the top and is re-keyed, a
+// timer that moves earlier flags the thread to rebuild the heap.
+//
+bool Thread::later(TimerSource* a,TimerSource* b)
+{
+    return a->_armedTime > b->_armedTime;
+}
+
+void Thread::addTimer(TimerSource* ts)
+{
+    if ( ts->_thread==this ) return;
+    ts->_thread = this;
+    ts->_armedTime = ts->deadline();
+    if ( ts->_slack > _maxSlack ) _maxSlack = ts->_slack;
+    _timers.push_back(ts);
+    std::push_heap(_timers.begin(),_timers.end(),later);
+}
+// the timer at index moved to a later deadline, restore the heap below it
+void Thread::siftDown(uint32_t index)
+{
+    uint32_t size = _timers.size();
     while(true) {
-        uint64_t now = Sys::millis();
-        uint64_t expTime = now + 5000;
-        TimerSource *expiredTimer = 0;
-        // find next expired timer if any within 5 sec
+        uint32_t first = index;
+        uint32_t left = 2*index+1;
+        if ( left < size && later(_timers[first],_timers[left]) ) first = left;
+        if ( left+1 < size && later(_timers[first],_timers[left+1]) ) first = left+1;
+        if ( first == index ) return;
+        std::swap(_timers[index],_timers[first]);
+        index = first;
+    }
+}
+// slack timers with an open window : their deadline is at most bound, a
+// key is never later than the deadline, so subtrees keyed past it are skipped
+void Thread::openWindows(uint32_t index,uint64_t now,uint64_t bound)
+{
+    if ( index >= _timers.size() || _timers[index]->_armedTime > bound ) return;
+    TimerSource* timer = _timers[index];
+    if ( timer->_slack && timer->expireTime() <= now ) _coalesced.push_back(index);
+    openWindows(2*index+1,now,bound);
+    openWindows(2*index+2,now,bound);
+}
+// returns the usec the request took
+uint32_t Thread::requestTimer(TimerSource* timer,uint64_t now)
+{
+    uint64_t start=Sys::micros();
+#ifdef INVOKER_STATS
+    timer->_stats.wait.add((now - timer->expireTime()) * 1000);
+#endif
+    timer->request();
+    uint32_t exec=Sys::micros()-start;
+#ifdef INVOKER_STATS
+    timer->_stats.exec.add(exec);
+#endif
+    return exec;
+}
+// fire all timers past their deadline at now, and when one did, the
+// expired ones still within their slack. Return the next deadline.
+uint64_t Thread::expireTimers(uint64_t now)
+{
+    if ( _timersChanged ) {
+        _timersChanged=false;
+        _maxSlack=0;
         for (auto timer : _timers) {
-            if (timer->expireTime() < expTime) {
-                expTime = timer->expireTime();
-                expiredTimer = timer;
-            }
+            timer->_armedTime = timer->deadline();
+            if ( timer->_slack > _maxSlack ) _maxSlack = timer->_slack;
         }
+        std::make_heap(_timers.begin(),_timers.end(),later);
+    }
+    uint32_t fired=0;
+    while ( fired < _timers.size() ) {
+        TimerSource* timer = _timers.front();
+        uint64_t deadline = timer->deadline();
+        if ( deadline == timer->_armedTime ) {
+            if ( deadline > now ) break;
+            if ( now-deadline > 100 ) INFO("Timer[%X] already expired by %u msec on thread '%s'.",timer,(uint32_t)(now-deadline),_name.c_str());
+            uint32_t deltaExec = requestTimer(timer,now);
+            fired++;
+            if ( deltaExec > 50000 ) WARN("Timer [%X] request slow %u usec on thread '%s'",timer,deltaExec,_name.c_str());
+        }
+        std::pop_heap(_timers.begin(),_timers.end(),later);
+        _timers.back()->_armedTime = _timers.back()->deadline();
+        std::push_heap(_timers.begin(),_timers.end(),later);
+    }
+    // awake anyway : take along the timers whose window is open. They move
+    // to a later deadline, re-keyed from the deepest up so that a sift
+    // never moves an index still to do
+    if ( fired && _maxSlack ) {
+        _coalesced.clear();
+        openWindows(0,now,now+_maxSlack);
+        std::sort(_coalesced.begin(),_coalesced.end(),std::greater<uint32_t>());
+        for (uint32_t index : _coalesced) {
+            TimerSource* timer = _timers[index];
+            requestTimer(timer,now);
+            _threadStats.timersCoalesced++;
+            timer->_armedTime = timer->deadline();
+            siftDown(index);
+        }
+    }
+    // the top can still carry a key older than its deadline
+    while ( !_timers.empty() && _timers.front()->_armedTime != _timers.front()->deadline() ) {
+        _timers.front()->_armedTime = _timers.front()->deadline();
+        siftDown(0);
+    }
+    return _timers.empty() ? UINT64_MAX : _timers.front()->_armedTime;
+}
+
+void Thread::execute(Invoker* prq)
+{
+    prq->unschedule();
+    uint8_t lane = prq->_priority;
+    uint32_t latency = Sys::micros() - prq->_enqueueTime;
+    _threadStats.laneInvokes[lane]++;
+    _threadStats.laneTotalLatency[lane]+=latency;
+    if ( latency > _threadStats.laneMaxLatency[lane] ) _threadStats.laneMaxLatency[lane]=latency;
+#ifdef INVOKER_STATS
+    uint32_t depth = _queueDepth--;
+    if ( depth > _threadStats.queueHighWater ) _threadStats.queueHighWater = depth;
+    prq->_stats.wait.add(latency);
+    uint64_t invokeStart=Sys::micros();
+    prq->invoke();
+    prq->_stats.exec.add(Sys::micros()-invokeStart);
+#else
+    prq->invoke();
+#endif
+}
+
+void Thread::run()
+{
+    INFO("Thread '%s' started ",_name.c_str());
+#ifdef FREERTOS
+    if ( _task==0 ) _task = xTaskGetCurrentTaskHandle(); // run() without start()
+#endif
+    _running = true;
+    _statsStart = Sys::millis();
+    while(!_stop) {
+        if ( _statsReset ) statsReset();
+        uint64_t expTime = expireTimers(Clock::millis());
+        uint64_t now = Clock::millis();
+        if ( expTime > now + 5000 ) expTime = now + 5000;
         int32_t waitTime = (expTime-now); // ESP_OPEN_RTOS seems to double sleep time ?
 
 //		INFO(" waitTime : %d ",waitTime);
-        if ( noWaits % 1000 == 999 ) WARN(" noWaits : %d in thread %s waitTime %d ",noWaits,_name.c_str(),waitTime);
-        if ( waitTime > 0 ) {
-            Invoker *prq;
-            TickType_t tickWaits  = pdMS_TO_TICKS(waitTime) ;
-            if ( tickWaits==0) noWaits++;
-            if (xQueueReceive(_workQueue, &prq, tickWaits) == pdTRUE) {
-                uint64_t start=Sys::millis();
-                prq->invoke();
-                uint32_t delta=Sys::millis()-start;
+        if ( _noWaits % 1000 == 999 ) WARN(" noWaits : %d in thread %s waitTime %d ",_noWaits,_name.c_str(),waitTime);
+        if ( waitTime <= 0 ) _noWaits++;
+        Invoker *prq;
+        if (waitFor(prq, Sys::micros() + (waitTime > 0 ? waitTime * 1000ULL : 0))) {
+            // drain what is ready, timers get their turn after the batch
+            uint64_t batchStart=Sys::millis();
+            uint64_t start=batchStart;
+            uint32_t count=0;
+            while(true) {
+                execute(prq);
+                count++;
+                uint64_t end=Sys::millis();
+                uint32_t delta=end-start;
                 if ( delta > 50 ) WARN("Invoker [%X] slow %d msec invoker on thread '%s'.",prq,delta,_name.c_str());
-            } else {
-                noWaits=0;
-            }
-        } else {
-            noWaits++;
-            if (expiredTimer) {
-                if ( -waitTime>100 ) INFO("Timer[%X] already expired by %u msec on thread '%s'.",expiredTimer,-waitTime,_name.c_str());
-                uint64_t start=Sys::millis();
-                expiredTimer->request();
-                uint32_t deltaExec=Sys::millis()-start;
-                if ( deltaExec > 50 ) WARN("Timer [%X] request slow %d msec on thread '%s'",expiredTimer,deltaExec,_name.c_str());
+                if ( count >= _maxBatch ) break;
+                if ( end-batchStart >= _batchBudget ) {
+                    _threadStats.budgetExceeded++;
+                    break;
+                }
+                // a due timer goes before the rest of the batch, any lane
+                if ( !_timers.empty() && _timers.front()->_armedTime <= Clock::millis() ) break;
+                if ( !receive(prq,0) ) break;
+                start=end;
             }
+            _threadStats.batches++;
+            _threadStats.invokes+=count;
+            if ( count > _threadStats.maxBatch ) _threadStats.maxBatch=count;
+        } else if ( waitTime > 0 ) {
+            _noWaits=0;
+        }
+        if ( waitTime > 0 ) _threadStats.wakeups++;
+    }
+    INFO("Thread '%s' stopped ",_name.c_str());
+    _running = false; // the last touch of this
+}
+
+void Thread::stop()
+{
+    _stop = true;
+    wake();
+    while ( _running ) Sys::delay(1);
+}
+/*
+ ____  _                 _       _   _
+/ ___|(_)_ __ ___  _   _| | __ _| |_(_) ___  _ __
+\___ \| | '_ ` _ \| | | | |/ _` | __| |/ _ \| '_ \
+ ___) | | | | | | | |_| | | (_| | |_| | (_) | | | |
+|____/|_|_| |_| |_|\__,_|_|\__,_|\__|_|\___/|_| |_|
+*/
+// what run() does in one pass, without waiting : the due timers, then
+// a batch of what is queued. Returns the next deadline.
+uint64_t Thread::step(bool& busy)
+{
+    if ( _statsReset ) statsReset();
+    uint64_t next = expireTimers(Clock::millis());
+    Invoker* prq;
+    uint32_t count = 0;
+    while ( count < _maxBatch && receive(prq,0) ) {
+        execute(prq);
+        count++;
+    }
+    busy = count > 0;
+    if ( busy ) {
+        _threadStats.batches++;
+        next = _timers.empty() ? UINT64_MAX : _timers.front()->_armedTime;
+    }
+    return next;
+}
+
+uint64_t Simulation::run(uint64_t msec, uint64_t maxSteps)
+{
+    if ( !Clock::simulated() ) {
+        ERROR("Simulation::run() without Clock::simulate(), would run in Sys time");
+        return 0;
+    }
+    uint64_t end = Clock::millis() + msec;
+    uint64_t steps = 0;
+    while(true) {
+        if ( steps >= maxSteps ) {
+            WARN("Simulation::run() stopped after %llu passes at %llu msec",steps,Clock::millis());
+            return steps;
+        }
+        bool busy = false;
+        uint64_t next = UINT64_MAX;
+        for (auto thread : _threads) {
+            bool threadBusy;
+            uint64_t threadNext = thread->step(threadBusy);
+            busy |= threadBusy;
+            if ( threadNext < next ) next = threadNext;
         }
+        steps++;
+        if ( busy ) continue; // invokers can post to other threads at this time
+        if ( next > end ) break;
+        Clock::advanceTo(next);
     }
+    Clock::advanceTo(end);
+    return steps;
 }
@@ -25,13 +25,29 @@ typedef std::string NanoString;
 #include <freertos/queue.h>
 #include <freertos/semphr.h>
 
+#include "esp_attr.h"
 #include "esp_system.h"
+#include "esp_timer.h"
 #include "freertos/task.h"
 #include "nvs.h"
 #include "nvs_flash.h"
 #define PRO_CPU 0
 #define APP_CPU 1
 #endif
+//-------------------------------------------------- LINUX
+#if defined(__linux__) && !defined(FREERTOS)
+#ifndef LINUX
+#define LINUX
+#endif
+#include <pthread.h>
+
+#include <chrono>
+#include <condition_variable>
+#include <mutex>
+#include <string>
+#include <thread>
+typedef std::string NanoString;
+#endif
 //-------------------------------------------------- ARDUINO
 #ifdef ARDUINO
 #define NO_ATOMIC
@@ -64,12 +80,29 @@ typedef String NanoString;
 #ifndef NO_ATOMIC
 #include <atomic>
 #endif
+// the interrupt path : in IRAM on ESP32, it runs with the flash cache off
+// for handlers registered with ESP_INTR_FLAG_IRAM
+#ifndef IRAM_ATTR
+#define IRAM_ATTR
+#endif
 #undef min
 #undef max
 #include <Sys.h>
+// usec on the interrupt path, the time base of Sys::micros() : Sys is in
+// flash, esp_timer_get_time() is in IRAM
+inline uint64_t IRAM_ATTR isrMicros() {
+#ifdef ESP32_IDF
+  return esp_timer_get_time();
+#else
+  return Sys::micros();
+#endif
+}
 
 #include <functional>
+#include <new>
+#include <type_traits>
 #include <unordered_map>
+#include <utility>
 #include <vector>
 
 typedef struct {
@@ -80,8 +113,118 @@ typedef struct {
   uint32_t bufferPushCasFailed = 0;
   uint32_t bufferPopCasFailed = 0;
   uint32_t bufferCasRetries = 0;
+  uint32_t bufferOverwrite = 0;
 } NanoStats;
 extern NanoStats stats;
+//__________________________________________________________________________
+//
+// Clock : the time the runtime decides on, timers and throttles read it.
+// It is Sys time, unless simulate() switched it to a virtual time that only
+// moves when a Simulation advances it.
+//
+class Clock {
+  static bool _simulated;
+  static uint64_t _virtualUsec;
+
+ public:
+  static inline uint64_t millis() {
+    return _simulated ? _virtualUsec / 1000 : Sys::millis();
+  }
+  static inline uint64_t micros() {
+    return _simulated ? _virtualUsec : Sys::micros();
+  }
+  // from Sys time on by default, timers already armed stay valid
+  static void simulate(uint64_t startMsec = Sys::millis()) {
+    _virtualUsec = startMsec * 1000;
+    _simulated = true;
+  }
+  static bool simulated() { return _simulated; }
+  static void advanceTo(uint64_t msec) {
+    if (msec * 1000 > _virtualUsec) _virtualUsec = msec * 1000;
+  }
+};
+
+//______________________________________________________________________
+// Delegate : a callable stored inline, no heap, no RTTI, no exceptions
+// a lambda capturing more than SIZE bytes fails at compile time, raise
+// DELEGATE_SIZE for bigger captures
+//
+#ifndef DELEGATE_SIZE
+#define DELEGATE_SIZE (4 * sizeof(void *))  // fits a std::function too
+#endif
+
+template <class SIGNATURE, size_t SIZE = DELEGATE_SIZE>
+class Delegate;
+
+template <class R, class... ARGS, size_t SIZE>
+class Delegate<R(ARGS...), SIZE> {
+  alignas(8) unsigned char _store[SIZE];
+  R (*_invoke)(void *, ARGS...) = 0;
+  void (*_copy)(void *, const void *) = 0;
+  void (*_destroy)(void *) = 0;
+
+  // callable with ARGS, with a result that converts to R. A void delegate
+  // drops the result, as std::function does
+  template <class F, class RESULT = decltype(std::declval<F &>()(
+                         std::declval<ARGS>()...))>
+  struct Compatible
+      : std::integral_constant<bool, std::is_void<R>::value ||
+                                         std::is_convertible<RESULT, R>::value> {
+  };
+  template <class F>
+  static R invokeF(void *f, ARGS... args) {
+    return static_cast<R>((*(F *)f)(std::forward<ARGS>(args)...));
+  }
+  template <class F>
+  static void copyF(void *dst, const void *src) {
+    new (dst) F(*(const F *)src);
+  }
+  template <class F>
+  static void destroyF(void *f) {
+    ((F *)f)->~F();
+  }
+  void assign(const Delegate &other) {
+    if (other._invoke) other._copy(_store, other._store);
+    _invoke = other._invoke;
+    _copy = other._copy;
+    _destroy = other._destroy;
+  }
+  void clear() {
+    if (_destroy) _destroy(_store);
+    _invoke = 0;
+    _copy = 0;
+    _destroy = 0;
+  }
+
+ public:
+  Delegate() {}
+  template <class F,
+            class = typename std::enable_if<!std::is_same<
+                typename std::decay<F>::type, Delegate>::value>::type,
+            class = typename std::enable_if<Compatible<F>::value>::type>
+  Delegate(F f) {
+    static_assert(sizeof(F) <= SIZE,
+                  "Delegate : lambda captures exceed DELEGATE_SIZE");
+    static_assert(alignof(F) <= 8, "Delegate : callable alignment too big");
+    new (_store) F(std::move(f));
+    _invoke = &invokeF<F>;
+    _copy = &copyF<F>;
+    _destroy = &destroyF<F>;
+  }
+  Delegate(const Delegate &other) { assign(other); }
+  Delegate &operator=(const Delegate &other) {
+    if (this != &other) {
+      clear();
+      assign(other);
+    }
+    return *this;
+  }
+  ~Delegate() { clear(); }
+  explicit operator bool() const { return _invoke != 0; }
+  R operator()(ARGS... args) const {
+    return _invoke((void *)_store, std::forward<ARGS>(args)...);
+  }
+};
 
 //______________________________________________________________________
 // INTERFACES nanoAkka
@@ -93,27 +236,175 @@ class AbstractQueue {
   virtual int pop(T &t) = 0;
   virtual int push(const T &t) = 0;  // const to be able to do something like
                                      // push({"topic","message"});
+  virtual uint32_t space() const = 0;  // values push() accepts right now
 };
 
+//__________________________________________________________________________
+//
+// Histogram : a count per power of 2, bucket i holds the values from 2^(i-1)
+// up to 2^i - 1, bucket 0 the zeros and the last bucket the rest
+//
+#define HISTOGRAM_BUCKETS 24
+class Histogram {
+  uint32_t _buckets[HISTOGRAM_BUCKETS] = {};
+  uint32_t _count = 0;
+  uint32_t _maxValue = 0;
+  uint64_t _total = 0;
+
+ public:
+  void add(uint32_t value) {
+    uint32_t bucket = value ? 32 - __builtin_clz(value) : 0;
+    if (bucket >= HISTOGRAM_BUCKETS) bucket = HISTOGRAM_BUCKETS - 1;
+    _buckets[bucket]++;
+    _count++;
+    _total += value;
+    if (value > _maxValue) _maxValue = value;
+  }
+  uint32_t count() const { return _count; }
+  uint32_t maxValue() const { return _maxValue; }
+  uint32_t average() const { return _count ? _total / _count : 0; }
+  uint32_t bucket(uint32_t idx) const { return _buckets[idx]; }
+  // upper bound of the bucket that reaches percent of the values
+  uint32_t percentile(uint32_t percent) const {
+    uint64_t target = ((uint64_t)_count * percent + 99) / 100;
+    uint32_t seen = 0;
+    for (uint32_t i = 0; i < HISTOGRAM_BUCKETS - 1; i++) {
+      seen += _buckets[i];
+      if (seen >= target) return i ? (1UL << i) - 1 : 0;
+    }
+    return _maxValue;
+  }
+  void reset() { *this = Histogram(); }
+};
+//
+// wait ( enqueue to invoke, or expiry to request ) and execution time in
+// usec of an invoker or timer, two histograms each : 224 bytes in every
+// invoker and timer. On by default on the host only, a device build
+// defines INVOKER_STATS to get them, NO_INVOKER_STATS leaves them out.
+//
+#if defined(LINUX) && !defined(NO_INVOKER_STATS) && !defined(INVOKER_STATS)
+#define INVOKER_STATS
+#endif
+typedef struct {
+  Histogram wait;
+  Histogram exec;
+} InvokerStats;
+
+//
+// the run queue of a thread has a lane per priority, a lane is only served
+// when the lanes above it are empty
+//
+#define PRIORITY_HIGH 0    // control loops
+#define PRIORITY_NORMAL 1  // anything else
+#define THREAD_LANES 2
+//
+// an invoker sits at most once in a thread queue : it is enqueued when it
+// goes from idle to pending, the thread clears the flag before invoke() and
+// invoke() handles everything queued up to then
+//
 class Invoker {
+#ifdef NO_ATOMIC
+  volatile bool _scheduled = false;
+#else
+  std::atomic<bool> _scheduled{false};
+  std::atomic<Invoker *> _next{nullptr};  // link in InvokerQueue
+  std::atomic<uint32_t> _pending{0};      // enqueues seen by a ThreadPool
+  friend class InvokerQueue;
+  friend class ThreadPool;
+#endif
+  uint8_t _priority = PRIORITY_NORMAL;
+  uint64_t _enqueueTime = 0;  // usec, for the lane latency
+#ifdef INVOKER_STATS
+  InvokerStats _stats;
+#endif
+  friend class Thread;
+
  public:
   virtual void invoke() = 0;
+#ifdef INVOKER_STATS
+  const InvokerStats &invokerStats() const { return _stats; }
+#endif
+  void priority(uint8_t p) {
+    _priority = p < THREAD_LANES ? p : THREAD_LANES - 1;
+  }
+  uint8_t priority() const { return _priority; }
+#ifdef NO_ATOMIC
+  bool IRAM_ATTR schedule() {
+    bool wasScheduled = _scheduled;
+    _scheduled = true;
+    return !wasScheduled;
+  }
+#else
+  bool IRAM_ATTR schedule() { return !_scheduled.exchange(true); }
+#endif
+  void unschedule() { _scheduled = false; }
+};
+#ifndef NO_ATOMIC
+//___________________________________________________________________________
+// intrusive multi producer, single consumer queue ( D. Vyukov )
+// linked through the invokers themselves : no capacity, no copies, no
+// overflow. push is wait-free and ISR safe, pop only on the owning thread.
+// An invoker can only be in one queue at a time, see Invoker::schedule()
+//
+class InvokerQueue {
+  class Stub : public Invoker {
+    void invoke() {}
+  } _stub;
+  std::atomic<Invoker *> _head;
+  Invoker *_tail;
+
+ public:
+  InvokerQueue() : _head(&_stub), _tail(&_stub) {}
+  void IRAM_ATTR push(Invoker *invoker) {
+    invoker->_next.store(nullptr, std::memory_order_relaxed);
+    Invoker *prev = _head.exchange(invoker, std::memory_order_acq_rel);
+    prev->_next.store(invoker, std::memory_order_release);
+  }
+  // returns 0 when empty or when a producer is halfway a push
+  Invoker *pop() {
+    Invoker *tail = _tail;
+    Invoker *next = tail->_next.load(std::memory_order_acquire);
+    if (tail == &_stub) {
+      if (next == nullptr) return 0;
+      _tail = next;
+      tail = next;
+      next = next->_next.load(std::memory_order_acquire);
+    }
+    if (next) {
+      _tail = next;
+      return tail;
+    }
+    if (tail != _head.load(std::memory_order_acquire)) return 0;
+    push(&_stub);
+    next = tail->_next.load(std::memory_order_acquire);
+    if (next) {
+      _tail = next;
+      return tail;
+    }
+    return 0;
+  }
 };
+#endif
 
 template <class T>
 class Subscriber {
  public:
   virtual void on(const T &t) = 0;
+  // subscribers that keep the value override this to move it
+  virtual void on(T &&t) { on((const T &)t); }
+  // credit : how many values on() accepts right now without dropping one
+  // a synchronous subscriber has no limit
+  virtual uint32_t credit() { return UINT32_MAX; }
   virtual ~Subscriber(){};
 };
 #include <bits/atomic_word.h>
 
 template <class T>
 class SubscriberFunction : public Subscriber<T> {
-  std::function<void(const T &t)> _func;
+  Delegate<void(const T &t)> _func;
 
  public:
-  SubscriberFunction(std::function<void(const T &t)> func) { _func = func; }
+  SubscriberFunction(Delegate<void(const T &t)> func) : _func(func) {}
   void on(const T &t) { _func(t); }
 };
 
@@ -123,7 +414,7 @@ class Publisher {
   virtual void subscribe(Subscriber<T> *listener) = 0;
   void operator>>(Subscriber<T> &listener) { subscribe(&listener); }
   void operator>>(Subscriber<T> *listener) { subscribe(listener); }
-  void operator>>(std::function<void(const T &t)> func) {
+  void operator>>(Delegate<void(const T &t)> func) {
     subscribe(new SubscriberFunction<T>(func));
   }
 };
@@ -131,11 +422,38 @@ class Publisher {
 class Requestable {
  public:
   virtual void request() = 0;
+  // demand : how many values a request() can deliver without a drop
+  virtual uint32_t demand() { return UINT32_MAX; }
 };
 //___________________________________________________________________________
 // lockfree buffer, isr ready
 //
 #define BUSY (1 << 15)  // busy read or write ptr
+//
+// ArrayQueue modes, selected at compile time by the 3rd template argument
+// QUEUE_CAS  : any number of producers and consumers, BUSY bit + CAS
+// QUEUE_SPSC : exactly one producer and one consumer thread, wait-free
+// QUEUE_MPMC : any number of producers and consumers, per slot sequence
+//              numbers, never sleeps and only fails when really full
+// QUEUE_LATEST : conflating, keeps only the newest value of one producer,
+//              push overwrites and never fails, SIZE is ignored
+//
+#define QUEUE_CAS 0
+#define QUEUE_SPSC 1
+#define QUEUE_MPMC 2
+#define QUEUE_LATEST 3
+
+#ifndef CACHE_LINE_SIZE
+#ifdef FREERTOS
+#define CACHE_LINE_SIZE 4  // no data cache on internal SRAM
+#else
+#define CACHE_LINE_SIZE 64
+#endif
+#endif
+
+constexpr uint32_t nextPowerOf2(uint32_t n, uint32_t p = 1) {
+  return p >= n ? p : nextPowerOf2(n, p << 1);
+}
 
 #if defined(ESP_OPEN_RTOS) || defined(ESP8266_IDF)
 // Set Interrupt Level
@@ -157,16 +475,15 @@ class Requestable {
 //#pragma GCC diagnostic ignored "-Warray-bounds"
 
 #ifdef NO_ATOMIC
-template <class T, int SIZE>
+template <class T, int SIZE, int MODE = QUEUE_CAS>
 class ArrayQueue : public AbstractQueue<T> {
   T _array[SIZE];
   int _readPtr;
   int _writePtr;
   inline int next(int idx) { return (idx + 1) % SIZE; }
 
- public:
-  ArrayQueue() { _readPtr = _writePtr = 0; }
-  int push(const T &t) {
+  template <class V>
+  int IRAM_ATTR pushValue(V &&t) {
     noInterrupts();
     int expected = _writePtr;
     int desired = next(expected);
@@ -176,11 +493,17 @@ class ArrayQueue : public AbstractQueue<T> {
       return ENOBUFS;
     }
     _writePtr = desired;
-    _array[desired] = std::move(t);
+    _array[desired] = std::forward<V>(t);
     interrupts();
     return 0;
   }
 
+ public:
+  ArrayQueue() { _readPtr = _writePtr = 0; }
+  int push(const T &t) { return pushValue(t); }
+  int push(T &&t) { return pushValue(std::move(t)); }
+  inline int IRAM_ATTR pushFromIsr(const T &t) { return pushValue(t); }
+
   int pop(T &t) {
     noInterrupts();
     int expected = _readPtr;
@@ -194,19 +517,56 @@ class ArrayQueue : public AbstractQueue<T> {
     interrupts();
     return 0;
   }
+  uint32_t space() const { return (_readPtr - _writePtr - 1 + SIZE) % SIZE; }
 };
-#else
+
 template <class T, int SIZE>
+class ArrayQueue<T, SIZE, QUEUE_LATEST> : public AbstractQueue<T> {
+  T _value;
+  bool _fresh = false;
+  uint32_t _overwrites = 0;
+
+  template <class V>
+  int IRAM_ATTR pushValue(V &&t) {
+    noInterrupts();
+    if (_fresh) {
+      _overwrites++;
+      stats.bufferOverwrite++;
+    }
+    _value = std::forward<V>(t);
+    _fresh = true;
+    interrupts();
+    return 0;
+  }
+
+ public:
+  int push(const T &t) { return pushValue(t); }
+  int push(T &&t) { return pushValue(std::move(t)); }
+  inline int IRAM_ATTR pushFromIsr(const T &t) { return pushValue(t); }
+  int pop(T &t) {
+    noInterrupts();
+    if (!_fresh) {
+      interrupts();
+      return ENOBUFS;
+    }
+    t = std::move(_value);
+    _fresh = false;
+    interrupts();
+    return 0;
+  }
+  uint32_t space() const { return UINT32_MAX; }  // never refuses a value
+  uint32_t overwrites() const { return _overwrites; }
+};
+#else
+template <class T, int SIZE, int MODE = QUEUE_CAS>
 class ArrayQueue : public AbstractQueue<T> {
   T _array[SIZE];
   std::atomic<int> _readPtr;
   std::atomic<int> _writePtr;
   inline int next(int idx) { return (idx + 1) % SIZE; }
 
- public:
-  ArrayQueue() { _readPtr = _writePtr = 0; }
-
-  int push(const T &t) {
+  template <class V>
+  int pushValue(V &&t) {
     int cnt = 0;
     int expected = 0;
     int desired = 0;
@@ -228,8 +588,7 @@ class ArrayQueue : public AbstractQueue<T> {
                                             std::memory_order_seq_cst)) {
         expected = desired;
         desired &= ~BUSY;
-        _array[desired]=t;
-//        _array[desired] = std::move(t);
+        _array[desired] = std::forward<V>(t);
         while (_writePtr.compare_exchange_strong(
                    expected, desired, std::memory_order_seq_cst,
                    std::memory_order_seq_cst) == false) {
@@ -254,6 +613,11 @@ class ArrayQueue : public AbstractQueue<T> {
     return -1;
   }
 
+ public:
+  ArrayQueue() { _readPtr = _writePtr = 0; }
+  int push(const T &t) { return pushValue(t); }
+  int push(T &&t) { return pushValue(std::move(t)); }
+
   int pop(T &t) {
     int cnt = 0;
     int expected = 0;
@@ -277,8 +641,7 @@ class ArrayQueue : public AbstractQueue<T> {
                                            std::memory_order_seq_cst)) {
         expected = desired;
         desired &= ~BUSY;
- //       t = std::move(_array[desired]);
-        t= _array[desired];
+        t = std::move(_array[desired]);
         while (_readPtr.compare_exchange_strong(
                    expected, desired, std::memory_order_seq_cst,
                    std::memory_order_seq_cst) == false) {
@@ -302,21 +665,299 @@ class ArrayQueue : public AbstractQueue<T> {
     stats.bufferPopCasFailed++;
     return -1;
   }
+  uint32_t space() const {
+    int r = _readPtr.load() & ~BUSY;
+    int w = _writePtr.load() & ~BUSY;
+    return (r - w - 1 + SIZE) % SIZE;
+  }
+};
+//___________________________________________________________________________
+// single producer, single consumer : only acquire/release on the indexes
+// indexes run free, the slot is found by masking with a power of 2 capacity
+//
+template <class T, int SIZE>
+class ArrayQueue<T, SIZE, QUEUE_SPSC> : public AbstractQueue<T> {
+  static constexpr uint32_t CAPACITY = nextPowerOf2(SIZE);
+  static constexpr uint32_t MASK = CAPACITY - 1;
+  // padding, not alignas : queues are in sinks on the heap too
+  std::atomic<uint32_t> _writePtr;
+  char _writePadding[CACHE_LINE_SIZE];
+  std::atomic<uint32_t> _readPtr;
+  char _readPadding[CACHE_LINE_SIZE];
+  T _array[CAPACITY];
+
+  template <class V>
+  int pushValue(V &&t) {
+    uint32_t w = _writePtr.load(std::memory_order_relaxed);
+    if (w - _readPtr.load(std::memory_order_acquire) >= (uint32_t)SIZE) {
+      stats.bufferOverflow++;
+      return ENOBUFS;
+    }
+    _array[w & MASK] = std::forward<V>(t);
+    _writePtr.store(w + 1, std::memory_order_release);
+    return 0;
+  }
+
+ public:
+  ArrayQueue() : _writePtr(0), _readPtr(0) {}
+  int push(const T &t) { return pushValue(t); }
+  int push(T &&t) { return pushValue(std::move(t)); }
+
+  int pop(T &t) {
+    uint32_t r = _readPtr.load(std::memory_order_relaxed);
+    if (r == _writePtr.load(std::memory_order_acquire)) return ENOBUFS;
+    t = std::move(_array[r & MASK]);
+    _readPtr.store(r + 1, std::memory_order_release);
+    return 0;
+  }
+  uint32_t space() const {
+    uint32_t r = _readPtr.load(std::memory_order_acquire);
+    return SIZE - (_writePtr.load(std::memory_order_acquire) - r);
+  }
+};
+//___________________________________________________________________________
+// bounded multi producer, multi consumer ( D. Vyukov )
+// every slot carries a sequence number that tells if it is free for the
+// writer at position pos ( seq==pos ) or filled for the reader ( seq==pos+1 )
+// a failed CAS means another thread made progress : retry, never sleep
+// capacity is SIZE rounded up to a power of 2, at least 2 : in a single
+// cell the filled sequence ( pos+1 ) is the free one of the next pos
+//
+template <class T, int SIZE>
+class ArrayQueue<T, SIZE, QUEUE_MPMC> : public AbstractQueue<T> {
+  static constexpr uint32_t CAPACITY = nextPowerOf2(SIZE < 2 ? 2 : SIZE);
+  static constexpr uint32_t MASK = CAPACITY - 1;
+  struct Cell {
+    std::atomic<uint32_t> sequence;
+    T data;
+  };
+  std::atomic<uint32_t> _writePtr;
+  char _writePadding[CACHE_LINE_SIZE];
+  std::atomic<uint32_t> _readPtr;
+  char _readPadding[CACHE_LINE_SIZE];
+  Cell _cells[CAPACITY];
+
+  template <class V>
+  int IRAM_ATTR pushValue(V &&t) {
+    uint32_t pos = _writePtr.load(std::memory_order_relaxed);
+    Cell *cell;
+    while (true) {
+      cell = &_cells[pos & MASK];
+      uint32_t seq = cell->sequence.load(std::memory_order_acquire);
+      int32_t diff = (int32_t)seq - (int32_t)pos;
+      if (diff == 0) {
+        if (_writePtr.compare_exchange_weak(pos, pos + 1,
+                                            std::memory_order_relaxed))
+          break;
+      } else if (diff < 0) {
+        stats.bufferOverflow++;
+        return ENOBUFS;
+      } else {
+        pos = _writePtr.load(std::memory_order_relaxed);
+      }
+    }
+    cell->data = std::forward<V>(t);
+    cell->sequence.store(pos + 1, std::memory_order_release);
+    return 0;
+  }
+
+ public:
+  ArrayQueue() : _writePtr(0), _readPtr(0) {
+    for (uint32_t i = 0; i < CAPACITY; i++)
+      _cells[i].sequence.store(i, std::memory_order_relaxed);
+  }
+  int push(const T &t) { return pushValue(t); }
+  int push(T &&t) { return pushValue(std::move(t)); }
+  // no logging, no blocking : same path, named for the call sites in an ISR
+  inline int IRAM_ATTR pushFromIsr(const T &t) { return pushValue(t); }
+
+  int pop(T &t) {
+    uint32_t pos = _readPtr.load(std::memory_order_relaxed);
+    Cell *cell;
+    while (true) {
+      cell = &_cells[pos & MASK];
+      uint32_t seq = cell->sequence.load(std::memory_order_acquire);
+      int32_t diff = (int32_t)seq - (int32_t)(pos + 1);
+      if (diff == 0) {
+        if (_readPtr.compare_exchange_weak(pos, pos + 1,
+                                           std::memory_order_relaxed))
+          break;
+      } else if (diff < 0) {
+        return ENOBUFS;
+      } else {
+        pos = _readPtr.load(std::memory_order_relaxed);
+      }
+    }
+    t = std::move(cell->data);
+    cell->sequence.store(pos + MASK + 1, std::memory_order_release);
+    return 0;
+  }
+  // a snapshot, producers and consumers can move on meanwhile
+  // a consumer moves _readPtr before it frees the cell : the cell of the
+  // next push is checked too, or a credit could end in an ENOBUFS
+  uint32_t space() const {
+    uint32_t r = _readPtr.load(std::memory_order_acquire);
+    uint32_t w = _writePtr.load(std::memory_order_acquire);
+    uint32_t used = w - r;
+    if (used >= CAPACITY) return 0;
+    if (_cells[w & MASK].sequence.load(std::memory_order_acquire) != w)
+      return 0;  // still moved out by a consumer, or taken by a producer
+    return CAPACITY - used;
+  }
+};
+//___________________________________________________________________________
+// conflating triple buffer : the producer and the consumer each own a slot,
+// the third one is exchanged through _middle together with a FRESH bit.
+// One producer only, the consumer always gets the newest value.
+//
+template <class T, int SIZE>
+class ArrayQueue<T, SIZE, QUEUE_LATEST> : public AbstractQueue<T> {
+  static const uint8_t FRESH = 4;
+  T _slots[3];
+  uint8_t _write = 0;  // producer slot
+  uint8_t _read = 1;   // consumer slot
+  std::atomic<uint8_t> _middle;
+  std::atomic<uint32_t> _overwrites;
+
+  template <class V>
+  int IRAM_ATTR pushValue(V &&t) {
+    _slots[_write] = std::forward<V>(t);
+    uint8_t previous = _middle.exchange(_write | FRESH, std::memory_order_acq_rel);
+    if (previous & FRESH) {
+      _overwrites.fetch_add(1, std::memory_order_relaxed);
+      stats.bufferOverwrite++;
+    }
+    _write = previous & ~FRESH;
+    return 0;
+  }
+
+ public:
+  ArrayQueue() : _middle(2), _overwrites(0) {}
+  int push(const T &t) { return pushValue(t); }
+  int push(T &&t) { return pushValue(std::move(t)); }
+  inline int IRAM_ATTR pushFromIsr(const T &t) { return pushValue(t); }
+  int pop(T &t) {
+    if ((_middle.load(std::memory_order_relaxed) & FRESH) == 0) return ENOBUFS;
+    _read = _middle.exchange(_read, std::memory_order_acq_rel) & ~FRESH;
+    t = std::move(_slots[_read]);
+    return 0;
+  }
+  uint32_t space() const { return UINT32_MAX; }  // never refuses a value
+  uint32_t overwrites() const { return _overwrites.load(); }
 };
 #endif
 
 // STREAMS
 class TimerSource;
+//
+// where async sinks and flows send their invokers : a Thread or a ThreadPool
+//
+class Dispatcher {
+ public:
+  virtual int enqueue(Invoker *invoker) = 0;
+  virtual int enqueueFromIsr(Invoker *invoker) = 0;
+  virtual ~Dispatcher() {}
+};
+
+typedef struct {
+  uint32_t batches = 0;         // wakeups that found work
+  uint32_t invokes = 0;         // invokers run
+  uint32_t maxBatch = 0;        // most invokers run in one wakeup
+  uint32_t budgetExceeded = 0;  // batches cut short by the time budget
+  uint32_t wakeups = 0;         // waits for work or the next timer
+  uint32_t timersCoalesced = 0;  // timers fired early in a shared wakeup
+  uint32_t queueHighWater = 0;   // most invokers queued, INVOKER_STATS only
+  // per lane, latency is usec from enqueue to invoke
+  uint32_t laneInvokes[THREAD_LANES] = {};
+  uint32_t laneMaxLatency[THREAD_LANES] = {};
+  uint64_t laneTotalLatency[THREAD_LANES] = {};
+} ThreadStats;
 
-class Thread {
+// how a thread waits for work until its next timer
+#define WAIT_BLOCK 0            // block, below a tick wake up to a tick late
+#define WAIT_SPIN_THEN_BLOCK 1  // spin a while, block whole ticks, spin the rest
+#define WAIT_YIELD_SPIN 2       // never block, yield between polls : takes a core
+
+#define THREAD_ANY_CORE -1
 #ifdef FREERTOS
-  QueueHandle_t _workQueue = 0;
+#define THREAD_STACK_SIZE 20000  // as xTaskCreate takes it : bytes on ESP32
+#define THREAD_PRIORITY tskIDLE_PRIORITY
 #else
-  ArrayQueue<Invoker *, 10> _workQueue;
+#define THREAD_STACK_SIZE 0  // platform default
+#define THREAD_PRIORITY 0
+#endif
+
+class Thread : public Dispatcher {
+#if defined(FREERTOS) && defined(NO_ATOMIC)
+  QueueHandle_t _workQueue[THREAD_LANES] = {};
+  TaskHandle_t _task = 0;
+#elif defined(FREERTOS)
+  InvokerQueue _workQueue[THREAD_LANES];
+  TaskHandle_t _task = 0;  // woken by task notification
+  Invoker *pop();
+#elif defined(LINUX)
+  InvokerQueue _workQueue[THREAD_LANES];
+  std::mutex _mutex;
+  std::condition_variable _wakeup;
+  Invoker *pop();
+#else
+  ArrayQueue<Invoker *, 10> _workQueue[THREAD_LANES];
 #endif
   uint32_t queueOverflow = 0;
+  uint32_t _noWaits = 0;
   void createQueue();
-  std::vector<TimerSource *> _timers;
+  bool receive(Invoker *&invoker, uint32_t waitUsec);
+  bool waitFor(Invoker *&invoker, uint64_t deadline);
+  uint8_t _waitStrategy = WAIT_BLOCK;
+  uint32_t _spinUsec = 0;
+  Histogram _wakeLatency;  // usec from enqueue to the end of a wait
+  std::vector<TimerSource *> _timers;  // min-heap on armed expire time
+  volatile bool _timersChanged = false;
+  static bool later(TimerSource *a, TimerSource *b);
+  uint32_t _maxSlack = 0;               // widest timer window, bounds the walk
+  std::vector<uint32_t> _coalesced;     // heap indexes fired along
+  void siftDown(uint32_t index);
+  void openWindows(uint32_t index, uint64_t now, uint64_t bound);
+  uint64_t expireTimers(uint64_t now);
+  void execute(Invoker *invoker);
+  uint64_t step(bool &busy);
+  friend class Simulation;
+  uint32_t requestTimer(TimerSource *timer, uint64_t now);
+  uint32_t _maxBatch = 16;
+  uint32_t _batchBudget = 10;  // msec before timers are checked again
+  ThreadStats _threadStats;
+  uint64_t _statsStart = 0;  // msec, run() or the last resetThreadStats()
+#if defined(INVOKER_STATS) && defined(NO_ATOMIC)
+  volatile uint32_t _queueDepth = 0;
+#elif defined(INVOKER_STATS)
+  std::atomic<uint32_t> _queueDepth{0};
+#endif
+  // only counts, the thread takes the high water when it pops : nothing
+  // leaves the queue in between, so the depth it sees is the peak since
+  void IRAM_ATTR queued() {
+#ifdef INVOKER_STATS
+    ++_queueDepth;
+#endif
+  }
+  uint32_t _stackSize = THREAD_STACK_SIZE;
+  uint32_t _priority = THREAD_PRIORITY;
+  int _core = THREAD_ANY_CORE;
+#ifdef NO_ATOMIC
+  volatile bool _stop = false;
+  volatile bool _running = false;
+  volatile bool _statsReset = false;
+#else
+  std::atomic<bool> _stop{false};     // run() returns at the next pass
+  std::atomic<bool> _running{false};  // from start() until run() returned
+  std::atomic<bool> _statsReset{false};  // run() resets its stats
+#endif
+  void statsReset() {
+    _statsReset = false;
+    _threadStats = ThreadStats();
+    _wakeLatency.reset();
+    _statsStart = Sys::millis();
+  }
+  void wake();
   static int _id;
   NanoString _name;
 
@@ -329,29 +970,217 @@ class Thread {
     _name = "thread-%d" + _id++;
     createQueue();
   }
+  // task options, before start()
+  Thread &stackSize(uint32_t size) {
+    _stackSize = size;
+    return *this;
+  }
+  Thread &priority(uint32_t priority) {
+    _priority = priority;
+    return *this;
+  }
+  Thread &core(int core) {
+    _core = core;
+    return *this;
+  }
+  Thread &waitStrategy(uint8_t strategy, uint32_t spinUsec = 50) {
+    _waitStrategy = strategy;
+    _spinUsec = spinUsec;
+    return *this;
+  }
+  const Histogram &wakeLatency() const { return _wakeLatency; }
+  // the least free stack seen so far, 0 when unknown
+  uint32_t stackFree();
   void start();
   int enqueue(Invoker *invoker);
   int enqueueFromIsr(Invoker *invoker);
   void run();
   void loop();
-  void addTimer(TimerSource *ts) { _timers.push_back(ts); }
+  // ends run() and waits for it, the invokers and timers of the thread
+  // are not run anymore : after this the thread can be deleted, or
+  // start()ed again
+  void stop();
+  // invoke up to maxInvokes per wakeup, within budgetMsec
+  void batch(uint32_t maxInvokes, uint32_t budgetMsec) {
+    _maxBatch = maxInvokes ? maxInvokes : 1;
+    _batchBudget = budgetMsec;
+  }
+  const ThreadStats &threadStats() { return _threadStats; }
+  // the stats are written by the thread itself : a running thread resets
+  // them at its next pass, a stopped one right away
+  void resetThreadStats() {
+    if (_running) {
+      _statsReset = true;
+      wake();
+    } else
+      statsReset();
+  }
+  uint32_t wakeupsPerSec() {
+    uint64_t msec = Sys::millis() - _statsStart;
+    return msec ? (uint64_t)_threadStats.wakeups * 1000 / msec : 0;
+  }
+  void addTimer(TimerSource *ts);
+  // a timer moved before its armed time, rebuild the heap on the next pass
+  void timersChanged() { _timersChanged = true; }
+};
+//__________________________________________________________________________
+//
+// Simulation : runs threads on the calling thread in virtual time. When
+// none has work left, the clock jumps to the earliest timer deadline, so
+// hours of timer driven behaviour take as long as the work itself, in the
+// same order on every run. The threads are not start()ed. MicroTimerSource
+// keeps real time.
+//
+//  Clock::simulate();
+//  Simulation sim;
+//  sim(workerThread)(mqttThread);
+//  sim.run(3600 * 1000);  // an hour
+//
+#ifndef SIMULATION_MAX_STEPS
+#define SIMULATION_MAX_STEPS 1000000
+#endif
+class Simulation {
+  std::vector<Thread *> _threads;
+
+ public:
+  Simulation &operator()(Thread &thread) {
+    _threads.push_back(&thread);
+    return *this;
+  }
+  // advances the clock by msec, returns the passes made. Invokers that keep
+  // each other busy never let the clock move : after maxSteps passes it
+  // stops where it is. Only runs after Clock::simulate()
+  uint64_t run(uint64_t msec, uint64_t maxSteps = SIMULATION_MAX_STEPS);
 };
 
+//__________________________________________________________________________`
+//
+// SubscriberList : the first N subscribers are stored inline, only a
+// source with more subscribers allocates
+//
+template <class T, int N = 2>
+class SubscriberList {
+  Subscriber<T> *_inline[N];
+  Subscriber<T> **_heap = 0;
+  uint16_t _count = 0;
+  uint16_t _capacity = N;
+
+  void copy(const SubscriberList &other) {
+    _count = other._count;
+    _capacity = other._capacity;
+    _heap = _capacity > N ? new Subscriber<T> *[_capacity] : 0;
+    for (uint32_t i = 0; i < _count; i++) items()[i] = other.items()[i];
+  }
+
+ public:
+  SubscriberList() {}
+  SubscriberList(const SubscriberList &other) { copy(other); }
+  SubscriberList &operator=(const SubscriberList &other) {
+    if (this != &other) {
+      delete[] _heap;
+      copy(other);
+    }
+    return *this;
+  }
+  ~SubscriberList() { delete[] _heap; }
+  inline Subscriber<T> **items() { return _heap ? _heap : _inline; }
+  inline Subscriber<T> *const *items() const { return _heap ? _heap : _inline; }
+  inline uint32_t size() const { return _count; }
+  inline Subscriber<T> *operator[](uint32_t idx) const { return items()[idx]; }
+  Subscriber<T> *const *begin() const { return items(); }
+  Subscriber<T> *const *end() const { return items() + _count; }
+  void add(Subscriber<T> *subscriber) {
+    if (_count == _capacity) {
+      Subscriber<T> **larger = new Subscriber<T> *[_capacity * 2];
+      for (uint32_t i = 0; i < _count; i++) larger[i] = items()[i];
+      delete[] _heap;
+      _heap = larger;
+      _capacity *= 2;
+    }
+    items()[_count++] = subscriber;
+  }
+};
+//__________________________________________________________________________`
+//
+// DemandProbe : the sources the calling thread is asking demand() of. A
+// source met again is wired in a loop ( see Flow::== ), other threads probe
+// the same source on their own
+//
+#ifndef DEMAND_DEPTH
+#define DEMAND_DEPTH 16
+#endif
+#ifdef NO_ATOMIC
+#define PROBE_LOCAL
+#else
+#define PROBE_LOCAL thread_local
+#endif
+class DemandProbe {
+  struct Stack {
+    const void *sources[DEMAND_DEPTH];
+    uint32_t depth = 0;
+  };
+  static Stack &stack() {
+    static PROBE_LOCAL Stack s;
+    return s;
+  }
+  bool _pushed = false;
+
+ public:
+  DemandProbe(const void *source) {
+    Stack &s = stack();
+    for (uint32_t i = 0; i < s.depth; i++)
+      if (s.sources[i] == source) return;
+    if (s.depth == DEMAND_DEPTH) return;  // deeper : no limit from there
+    s.sources[s.depth++] = source;
+    _pushed = true;
+  }
+  ~DemandProbe() {
+    if (_pushed) stack().depth--;
+  }
+  bool loop() const { return !_pushed; }
+};
 //__________________________________________________________________________`
 //
 template <class T>
 class Source : public Publisher<T>, public Requestable {
-  std::vector<Subscriber<T> *> _listeners;
+  SubscriberList<T> _listeners;
   T _last;
+  bool _cache = true;
 
  public:
-  void subscribe(Subscriber<T> *listener) { _listeners.push_back(listener); }
+  void subscribe(Subscriber<T> *listener) { _listeners.add(listener); }
+  // the smallest credit of the subscribers, 0 : an emit() now gets dropped
+  // somewhere downstream, hold off or aggregate until there is demand again
+  uint32_t demand() {
+    DemandProbe probe(this);
+    if (probe.loop()) return UINT32_MAX;  // flows wired in a loop
+    uint32_t d = UINT32_MAX;
+    for (Subscriber<T> *l : _listeners) {
+      uint32_t c = l->credit();
+      if (c < d) d = c;
+    }
+    return d;
+  }
   void emit(const T &t) {
-    _last = t;
+    if (_cache) _last = t;
+    if (_listeners.size() == 1) {  // most sources have 1 subscriber
+      _listeners[0]->on(t);
+      return;
+    }
     for (Subscriber<T> *l : _listeners) {
       l->on(t);
     }
   }
+  // a temporary is moved into the last subscriber
+  void emit(T &&t) {
+    if (_cache) _last = t;
+    uint32_t count = _listeners.size();
+    if (count == 0) return;
+    for (uint32_t i = 0; i < count - 1; i++) _listeners[i]->on((const T &)t);
+    _listeners[count - 1]->on(std::move(t));
+  }
+  // no copy into last() on every emit, for sources nobody asks last() from
+  void cache(bool c) { _cache = c; }
   ~Source() { WARN(" Source destructor. Really ? "); }
   void last(T &last) { last = _last; }
 };
@@ -359,11 +1188,14 @@ class Source : public Publisher<T>, public Requestable {
 //
 template <class T>
 class LambdaSource : public Source<T> {
-  std::function<T()> _handler;
+  Delegate<T()> _handler;
 
  public:
-  LambdaSource(std::function<T()> handler) : _handler(handler){};
-  void request() { this->emit(_handler()); }
+  LambdaSource(Delegate<T()> handler) : _handler(handler){};
+  // the handler is not called when the value would be dropped anyway
+  void request() {
+    if (this->demand()) this->emit(_handler());
+  }
 };
 //__________________________________________________________________________
 //
@@ -400,6 +1232,25 @@ class ValueSource : public Source<T> {
   T &operator()() { return _t; }
   void pass(bool p) { _pass = p; }
 };
+//__________________________________________________________________________
+//
+// a percentile of a histogram as a polled value, 100 : the maximum
+//
+//  PercentileSource mqttExec(mqtt.invokerStats().exec, 99);
+//  mqttExec >> mqtt.toTopic<uint32_t>("system/mqtt/execP99");
+//
+class PercentileSource : public Source<uint32_t> {
+  const Histogram &_histogram;
+  uint32_t _percent;
+
+ public:
+  PercentileSource(const Histogram &histogram, uint32_t percent)
+      : _histogram(histogram), _percent(percent) {}
+  void request() {
+    this->emit(_percent >= 100 ? _histogram.maxValue()
+                               : _histogram.percentile(_percent));
+  }
+};
 //__________________________________________________________________________`
 //
 // TimerSource
@@ -416,16 +1267,35 @@ class TimerMsg {
   uint32_t id;
 };
 
+//
+// slack : msec a timer may fire late. The thread wakes up for the earliest
+// deadline ( expiry + slack ) and then fires every timer that already
+// expired, so timers with overlapping windows share one wakeup.
+//
 class TimerSource : public Source<TimerMsg> {
+  friend class Thread;
   uint32_t _interval = UINT32_MAX;
   bool _repeat = false;
   uint64_t _expireTime = UINT64_MAX;
+  uint32_t _slack = 0;
   uint32_t _id = 0;
+  Thread *_thread = 0;
+  uint64_t _armedTime = UINT64_MAX;  // deadline, position in the heap of _thread
+#ifdef INVOKER_STATS
+  InvokerStats _stats;
+#endif
+  uint64_t deadline() {
+    return _expireTime > UINT64_MAX - _slack ? UINT64_MAX : _expireTime + _slack;
+  }
   void setNewExpireTime() {
-    uint64_t now = Sys::millis();
+    uint64_t now = Clock::millis();
     _expireTime += _interval;
     if (_expireTime < now) _expireTime = now + _interval;
   }
+  // later expiry is picked up lazily when the timer reaches the heap top
+  void rearm() {
+    if (_thread && deadline() < _armedTime) _thread->timersChanged();
+  }
 
  public:
   TimerSource(Thread &thr, int id, uint32_t interval, bool repeat) {
@@ -435,25 +1305,34 @@ class TimerSource : public Source<TimerMsg> {
     if (repeat) start();
     thr.addTimer(this);
   }
-  TimerSource(Thread &thr) : TimerSource(thr, 0, UINT32_MAX, false) {
-    thr.addTimer(this);
-  }
+  TimerSource(Thread &thr) : TimerSource(thr, 0, UINT32_MAX, false) {}
 
-  TimerSource() { _expireTime = Sys::now() + _interval; };
+  TimerSource() { _expireTime = Clock::millis() + _interval; };
   ~TimerSource() { WARN(" timer destructor. Really ? "); }
 
   void attach(Thread &thr) { thr.addTimer(this); }
   void reset() { start(); }
-  void start() { _expireTime = Sys::millis() + _interval; }
+  void start() {
+    _expireTime = Clock::millis() + _interval;
+    rearm();
+  }
   void start(uint32_t interval) { _interval=interval; start();}
   void stop() { _expireTime = UINT64_MAX; }
   void interval(uint32_t i) { _interval = i; }
+  void slack(uint32_t msec) {
+    _slack = msec;
+    if (_thread) _thread->timersChanged();  // re-keys and bounds the windows
+  }
+  inline uint32_t slack() { return _slack; }
+#ifdef INVOKER_STATS
+  const InvokerStats &timerStats() const { return _stats; }
+#endif
   void request() {
-    if (Sys::millis() >= _expireTime) {
+    if (Clock::millis() >= _expireTime) {
       if (_repeat)
         setNewExpireTime();
       else
-        _expireTime = Sys::millis() + UINT32_MAX;
+        _expireTime = Clock::millis() + UINT32_MAX;
       TimerMsg tm = {_id};
       this->emit(tm);
     }
@@ -463,36 +1342,69 @@ class TimerSource : public Source<TimerMsg> {
   inline uint32_t interval() { return _interval; }
 };
 //-______________________________________________________ Sink
+//
+// what an async sink or queue flow does with a value its queue can't take.
+// Sources that check demand() don't get there, the policy is for the rest
+// DROP_OLDEST pops from the producer side : not for QUEUE_SPSC
+//
+#define OVERFLOW_DROP_NEWEST 0  // keep what is queued, drop the new value
+#define OVERFLOW_DROP_OLDEST 1  // drop the oldest queued value to make room
 //______________________
-template <class T, int S>
+template <class T, int S, int MODE = QUEUE_MPMC>
 class Sink : public Subscriber<T>, public Invoker {
-  ArrayQueue<T, S> _t;
-  std::function<void(const T &)> _func;
-  Thread *_thread = 0;
+  ArrayQueue<T, S, MODE> _t;
+  Delegate<void(const T &)> _func;
+  Dispatcher *_thread = 0;
+  uint8_t _overflow = OVERFLOW_DROP_NEWEST;
+  uint32_t _dropped = 0;
   /*   int next(int index)
      {
          return ++index % S;
      }*/
  T _lastValue;
 
+  template <class V>
+  void pushValue(V &&t) {
+    if (_t.push(std::forward<V>(t)) == 0) {  // a failed push leaves t as is
+      _thread->enqueue(this);
+      return;
+    }
+    _dropped++;
+    T oldest;
+    if (_overflow == OVERFLOW_DROP_OLDEST && _t.pop(oldest) == 0 &&
+        _t.push(std::forward<V>(t)) == 0)
+      _thread->enqueue(this);
+  }
+
  public:
   Sink() {
     _func = [&](const T &t) { WARN(" no handler attached to this sink "); };
   }
   ~Sink() { WARN(" Sink destructor. Really ? "); }
-  Sink(std::function<void(const T &)> handler) : _func(handler){};
+  Sink(Delegate<void(const T &)> handler) : _func(handler){};
 
   void on(const T &t) {
     if (_thread) {
-      if (_t.push(t)) {
-        // WARN(" sink full ");
-      } else {
-        _thread->enqueue(this);
-      }
+      pushValue(t);
     } else {
       _func(t);
     }
   }
+  // without a thread through on(const T&) : subclasses override that one
+  void on(T &&t) {
+    if (_thread) {
+      pushValue(std::move(t));
+    } else {
+      this->on(static_cast<const T &>(t));
+    }
+  }
+  uint32_t credit() { return _thread ? _t.space() : UINT32_MAX; }
+  void overflow(uint8_t policy) { _overflow = policy; }
+  uint32_t dropped() const { return _dropped; }
+  // from interrupt context : no logging, handler runs later on the thread
+  void IRAM_ATTR onFromIsr(const T &t) {
+    if (_thread && _t.pushFromIsr(t) == 0) _thread->enqueueFromIsr(this);
+  }
 
   virtual void request() {
     //        INFO("request %X",this);
@@ -500,24 +1412,72 @@ class Sink : public Subscriber<T>, public Invoker {
   }
   void invoke() {
     //                INFO("invoke %X",this);
-
-    if (_t.pop(_lastValue)) {
-      WARN(" no data in queue[%d] ", S);  // second subscriber
-                                          //          _func(_lastValue);
-    } else {
-      _func(_lastValue);
-    }
+    while (_t.pop(_lastValue) == 0) _func(_lastValue);
   }
 
-  void async(Thread &thread, std::function<void(const T &)> func) {
+  // thread : a Thread or a ThreadPool
+  void async(Dispatcher &thread, Delegate<void(const T &)> func) {
     _func = func;
     _thread = &thread;
   }
-  void sync(std::function<void(const T &)> func) {
+  // PRIORITY_HIGH : handled before the normal lane of the thread
+  void async(Dispatcher &thread, Delegate<void(const T &)> func,
+             uint8_t priority) {
+    this->priority(priority);
+    async(thread, func);
+  }
+  void sync(Delegate<void(const T &)> func) {
     _thread = 0;
     _func = func;
   }
   T operator()() { return _lastValue; }
+  const ArrayQueue<T, S, MODE> &queue() const { return _t; }
+};
+// telemetry : only the newest value is handled, see queue().overwrites()
+template <class T>
+using LatestSink = Sink<T, 1, QUEUE_LATEST>;
+//__________________________________________________________________________
+//
+// IsrSource : where an interrupt enters a flow. onFromIsr() only queues the
+// sample with its time and enqueues the source on the thread, the
+// subscribers run there, in order, out of interrupt context. T is copied in
+// the ISR : keep it a small POD.
+//
+//  IsrSource<int32_t, 16> captures(thread);   // in the ISR :
+//  captures.onFromIsr(delta, isrEntry);        // isrEntry = isrMicros()
+//
+template <class T, int N = 8, int MODE = QUEUE_MPMC>
+class IsrSource : public Source<T>, public Invoker {
+  typedef struct {
+    T value;
+    uint32_t isrTime;  // usec, low 32 bits of Sys::micros()
+  } Sample;
+  ArrayQueue<Sample, N, MODE> _samples;
+  Dispatcher &_thread;
+  uint32_t _dropped = 0;  // queue full in the ISR
+  Histogram _latency;     // usec from the ISR to the emit on the thread
+
+ public:
+  IsrSource(Dispatcher &thread) : _thread(thread) {}
+  // isrTime : taken at the ISR entry, to include the time spent before
+  void IRAM_ATTR onFromIsr(const T &t, uint32_t isrTime) {
+    Sample sample = {t, isrTime};
+    if (_samples.pushFromIsr(sample) == 0)
+      _thread.enqueueFromIsr(this);
+    else
+      _dropped++;
+  }
+  void IRAM_ATTR onFromIsr(const T &t) { onFromIsr(t, isrMicros()); }
+  void invoke() {
+    Sample sample;
+    while (_samples.pop(sample) == 0) {
+      _latency.add((uint32_t)Sys::micros() - sample.isrTime);
+      this->emit(sample.value);
+    }
+  }
+  void request() {}  // emits what the ISR delivers only
+  uint32_t dropped() const { return _dropped; }
+  const Histogram &latency() const { return _latency; }
 };
 
 //_________________________________________________ Flow ________________
@@ -525,6 +1485,8 @@ class Sink : public Subscriber<T>, public Invoker {
 template <class IN, class OUT>
 class Flow : public Subscriber<IN>, public Source<OUT> {
  public:
+  // a synchronous flow can take what its subscribers can take
+  uint32_t credit() { return this->demand(); }
   void operator==(Flow<OUT, IN> &flow) {
     this->subscribe(&flow);
     flow.subscribe(this);
@@ -532,36 +1494,56 @@ class Flow : public Subscriber<IN>, public Source<OUT> {
 };
 //_____________________________________________________________________________
 //
-template <class T, int S>
+template <class T, int S, int MODE = QUEUE_MPMC>
 class QueueFlow : public Flow<T, T>, public Invoker {
-  ArrayQueue<T, S> _queue;
-  std::function<void(const T &)> _func;
-  Thread *_thread = 0;
+  ArrayQueue<T, S, MODE> _queue;
+  Dispatcher *_thread = 0;
+  uint8_t _overflow = OVERFLOW_DROP_NEWEST;
+  uint32_t _dropped = 0;
+
+  template <class V>
+  void pushValue(V &&t) {
+    if (_queue.push(std::forward<V>(t)) == 0) {
+      _thread->enqueue(this);
+      return;
+    }
+    _dropped++;
+    T oldest;
+    if (_overflow == OVERFLOW_DROP_OLDEST && _queue.pop(oldest) == 0 &&
+        _queue.push(std::forward<V>(t)) == 0)
+      _thread->enqueue(this);
+  }
 
  public:
   void on(const T &t) {
     if (_thread) {
-      if (_queue.push(t)) {
-        //					WARN(" sink full ");
-      } else {
-        _thread->enqueue(this);
-      }
+      pushValue(t);
     } else {
       this->emit(t);
     }
   }
+  void on(T &&t) {
+    if (_thread) {
+      pushValue(std::move(t));
+    } else {
+      this->on(static_cast<const T &>(t));
+    }
+  }
+  uint32_t credit() { return _thread ? _queue.space() : this->demand(); }
+  void overflow(uint8_t policy) { _overflow = policy; }
+  uint32_t dropped() const { return _dropped; }
   virtual void request() { invoke(); }
   void invoke() {
     T value;
-    if (_queue.pop(value)) {
-      WARN(" no data ");
-    } else {
-      this->emit(value);
-    }
+    while (_queue.pop(value) == 0) this->emit(std::move(value));
   }
 
-  void async(Thread &thread) { _thread = &thread; }
-  void sync(std::function<void(const T &)> func) { _thread = 0; }
+  void async(Dispatcher &thread) { _thread = &thread; }
+  void async(Dispatcher &thread, uint8_t priority) {
+    this->priority(priority);
+    _thread = &thread;
+  }
+  void sync(Delegate<void(const T &)> func) { _thread = 0; }
 };
 
 //________________________________________________________________
@@ -569,7 +1551,7 @@ class QueueFlow : public Flow<T, T>, public Invoker {
 
 template <class IN, class OUT>
 class LambdaFlow : public Flow<IN, OUT> {
-  std::function<int(OUT &, const IN &)> _func;
+  Delegate<int(OUT &, const IN &)> _func;
 
  public:
   LambdaFlow() {
@@ -578,15 +1560,15 @@ class LambdaFlow : public Flow<IN, OUT> {
       return -1;
     };
   };
-  LambdaFlow(std::function<int(OUT &, const IN &)> func) : _func(func){};
-  void lambda(std::function<int(OUT &, const IN &)> func) { _func = func; }
+  LambdaFlow(Delegate<int(OUT &, const IN &)> func) : _func(func){};
+  void lambda(Delegate<int(OUT &, const IN &)> func) { _func = func; }
   virtual void on(const IN &in) {
     OUT out;
     if (_func(out, in)) {
       //				WARN(" conversion failed ");
       return;
     }
-    this->emit(out);
+    this->emit(std::move(out));
   }
   void request(){};
 };
@@ -594,7 +1576,7 @@ class LambdaFlow : public Flow<IN, OUT> {
 //________________________________________________________________
 //
 template <class IN, class OUT>
-Source<OUT> &operator>>(Publisher<OUT> &publisher, Flow<IN, OUT> &flow) {
+Source<OUT> &operator>>(Publisher<IN> &publisher, Flow<IN, OUT> &flow) {
   publisher.subscribe(&flow);
   return flow;
 }
@@ -615,8 +1597,9 @@ class ValueFlow : public Flow<T, T> {
     if (_pass) this->emit(_t);
   }
   T &operator()() { return _t; }
+  // an rvalue comes in through Subscriber::on(T&&), to this or an override
   void on(const T &in) {
-    _t = std::move(in);
+    _t = in;
     this->emit(_t);
   }
   void pass(bool p) { _pass = p; }
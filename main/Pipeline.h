@@ -0,0 +1,128 @@
+#ifndef PIPELINE_H
+#define PIPELINE_H
+#include <NanoAkka.h>
+#include <Kernels.h>
+//__________________________________________________________________________
+//
+// Pipeline : a chain of stages composed by value at compile time
+// the stages are inlined into one call, the only virtual calls left are
+// the on() of the pipeline and the emit() to its subscribers
+//
+// a stage is a callable : int operator()(OUT& out,const IN& in)
+// returning 0 passes out to the next stage, anything else stops the chain
+// ( same convention as LambdaFlow )
+//
+//  _rawCapture >> pipeline(MedianStage<int32_t, 5>()
+//                          >> stage<int32_t, int32_t>(toRpm)
+//                          >> ThrottleStage<int32_t>(100))
+//              >> rpmMeasured;
+//
+//__________________________________________________________________________
+template <class A, class B>
+class Fused;
+
+template <class SELF>
+class Pipe {
+ public:
+  template <class NEXT>
+  Fused<SELF, NEXT> operator>>(const NEXT &next) const {
+    return Fused<SELF, NEXT>(*(const SELF *)this, next);
+  }
+};
+
+template <class A, class B>
+class Fused : public Pipe<Fused<A, B>> {
+  A _a;
+  B _b;
+
+ public:
+  typedef typename A::In In;
+  typedef typename B::Out Out;
+  Fused(const A &a, const B &b) : _a(a), _b(b) {}
+  inline int operator()(Out &out, const In &in) {
+    typename A::Out between;
+    int rc = _a(between, in);
+    if (rc) return rc;
+    return _b(out, between);
+  }
+};
+//__________________________________________________________________________
+//
+// stage from a lambda or functor
+//
+template <class IN, class OUT, class F>
+class LambdaStage : public Pipe<LambdaStage<IN, OUT, F>> {
+  F _f;
+
+ public:
+  typedef IN In;
+  typedef OUT Out;
+  LambdaStage(const F &f) : _f(f) {}
+  inline int operator()(OUT &out, const IN &in) { return _f(out, in); }
+};
+
+template <class IN, class OUT, class F>
+LambdaStage<IN, OUT, F> stage(F f) {
+  return LambdaStage<IN, OUT, F>(f);
+}
+//__________________________________________________________________________
+//
+// value stages of the Filter.h flows
+//
+template <class T, int x>
+class MedianStage : public Pipe<MedianStage<T, x>> {
+  FastMedian<T, x> _mf;
+
+ public:
+  typedef T In;
+  typedef T Out;
+  inline int operator()(T &out, const T &in) {
+    _mf.addSample(in);
+    if (!_mf.isReady()) return ENODATA;
+    out = _mf.getMedian();
+    return 0;
+  }
+};
+
+template <class T>
+class ThrottleStage : public Pipe<ThrottleStage<T>> {
+  uint32_t _delta;
+  uint64_t _nextEmit;
+
+ public:
+  typedef T In;
+  typedef T Out;
+  ThrottleStage(uint32_t delta) : _delta(delta) {
+    _nextEmit = Clock::millis() + _delta;
+  }
+  inline int operator()(T &out, const T &in) {
+    uint64_t now = Clock::millis();
+    if (now <= _nextEmit) return EAGAIN;
+    _nextEmit = now + _delta;
+    out = in;
+    return 0;
+  }
+};
+//__________________________________________________________________________
+//
+// the Flow at the end points, interoperates with operator>>
+//
+template <class P>
+class PipelineFlow : public Flow<typename P::In, typename P::Out> {
+  P _pipe;
+
+ public:
+  PipelineFlow(const P &pipe) : _pipe(pipe) {}
+  void on(const typename P::In &in) {
+    typename P::Out out;
+    if (_pipe(out, in) == 0) this->emit(std::move(out));
+  }
+  void request(){};
+};
+// one allocation for the whole chain instead of one per stage
+template <class P>
+PipelineFlow<P> &pipeline(const P &pipe) {
+  return *new PipelineFlow<P>(pipe);
+}
+
+#endif
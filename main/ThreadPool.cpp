@@ -0,0 +1,246 @@
+#include "ThreadPool.h"
+#ifndef NO_ATOMIC
+/*
+ ____             _
+|  _ \ ___   ___ | |
+| |_) / _ \ / _ \| |
+|  __/ (_) | (_) | |
+|_|   \___/ \___/|_|
+*/
+#if defined(FREERTOS)
+//
+// a task per worker, pinned round robin over PRO_CPU and APP_CPU, woken by
+// a direct task notification
+//
+void PoolWorker::start(const char* name)
+{
+    _running = true;
+#ifdef ESP32_IDF
+    xTaskCreatePinnedToCore([](void* worker) {
+        ((PoolWorker*)worker)->run();
+        vTaskDelete(NULL);
+    }, name, POOL_STACK_SIZE, this, tskIDLE_PRIORITY + 1, &_task,
+    _index % portNUM_PROCESSORS);
+#else
+    xTaskCreate([](void* worker) {
+        ((PoolWorker*)worker)->run();
+        vTaskDelete(NULL);
+    }, name, POOL_STACK_SIZE, this, tskIDLE_PRIORITY + 1, &_task);
+#endif
+}
+
+void PoolWorker::wake()
+{
+    if (_task) xTaskNotifyGive(_task);
+}
+
+void IRAM_ATTR PoolWorker::wakeFromIsr()
+{
+    if (_task) {
+        BaseType_t higherPriorityTaskWoken = pdFALSE;
+        vTaskNotifyGiveFromISR(_task, &higherPriorityTaskWoken);
+        if (higherPriorityTaskWoken) portYIELD_FROM_ISR();
+    }
+}
+
+void PoolWorker::sleep(uint32_t msec)
+{
+    ulTaskNotifyTake(pdTRUE, pdMS_TO_TICKS(msec));
+}
+
+bool PoolWorker::current()
+{
+    return xTaskGetCurrentTaskHandle() == _task;
+}
+
+uint32_t ThreadPool::cores()
+{
+    return portNUM_PROCESSORS;
+}
+#elif defined(LINUX)
+//
+// a std::thread per worker, the signal flag covers a wake() that comes
+// between the last look for work and the wait
+//
+void PoolWorker::start(const char* name)
+{
+    _running = true;
+    std::thread thr([this]() {
+        run();
+    });
+    _id = thr.get_id();
+    pthread_setname_np(thr.native_handle(), name);
+    thr.detach();
+}
+
+void PoolWorker::wake()
+{
+    _signal = true;
+    {
+        std::lock_guard<std::mutex> lock(_mutex);
+    }
+    _wakeup.notify_one();
+}
+
+void IRAM_ATTR PoolWorker::wakeFromIsr()
+{
+    wake();
+}
+
+void PoolWorker::sleep(uint32_t msec)
+{
+    std::unique_lock<std::mutex> lock(_mutex);
+    _wakeup.wait_for(lock, std::chrono::milliseconds(msec), [&]() {
+        return _signal.exchange(false);
+    });
+}
+
+bool PoolWorker::current()
+{
+    return std::this_thread::get_id() == _id;
+}
+
+uint32_t ThreadPool::cores()
+{
+    uint32_t cores = std::thread::hardware_concurrency();
+    return cores ? cores : 1;
+}
+#endif
+
+PoolWorker::PoolWorker(ThreadPool& pool, uint32_t index)
+    : _pool(pool), _index(index), _idle(false), _running(false)
+{
+#if defined(LINUX)
+    _signal = false;
+#endif
+}
+// own deque first, then the inbox, then the other workers
+Invoker* PoolWorker::next()
+{
+    Invoker* invoker = _deque.take();
+    if ( invoker ) return invoker;
+    uint32_t moved=0;
+    while ((invoker = _inbox.pop()) != 0) {
+        if ( !_deque.push(invoker) ) return invoker; // full, run it now
+        moved++;
+    }
+    if ( moved > 1 ) _pool.wakeIdle(this); // something to steal
+    invoker = _deque.take();
+    if ( invoker ) return invoker;
+    invoker = _pool.steal(this);
+    if ( invoker ) _stats.steals++;
+    return invoker;
+}
+
+void PoolWorker::run()
+{
+    INFO("Pool worker %u started ",_index);
+    while(!_pool._stop) {
+        Invoker* invoker = next();
+        if ( invoker == 0 ) {
+            _idle = true;
+            invoker = next(); // work that came in meanwhile
+            if ( invoker == 0 ) {
+                _stats.sleeps++;
+                sleep(POOL_IDLE_MSEC);
+            }
+            _idle = false;
+            if ( invoker == 0 ) continue;
+        }
+        _pool.run(invoker);
+        _stats.invokes++;
+    }
+    _running = false; // the last touch of this
+}
+
+ThreadPool::ThreadPool(const char* name, uint32_t workers) : _name(name), _nextWorker(0), _stop(false)
+{
+    if ( workers==0 ) workers = cores();
+    for (uint32_t i = 0; i < workers; i++)
+        _workers.push_back(new PoolWorker(*this, i));
+}
+
+ThreadPool::~ThreadPool()
+{
+    stop();
+    for (PoolWorker* worker : _workers) delete worker;
+}
+
+void ThreadPool::start()
+{
+    _stop = false;
+    for (PoolWorker* worker : _workers) {
+        char name[16]; // task and thread names are short
+        snprintf(name,sizeof(name),"%s-%u",_name.c_str(),worker->_index);
+        worker->start(name);
+    }
+}
+
+void ThreadPool::stop()
+{
+    _stop = true;
+    for (PoolWorker* worker : _workers) worker->wake();
+    for (PoolWorker* worker : _workers)
+        while ( worker->_running ) Sys::delay(1);
+}
+//
+// _pending counts the enqueues of an invoker. Only the enqueue that takes it
+// from 0 hands it to a worker. That worker invokes until the count it saw
+// before the invoke() is all there is : values pushed during an invoke()
+// are handled by the same worker, never by a second one in parallel.
+//
+void ThreadPool::run(Invoker* invoker)
+{
+    while (true) {
+        uint32_t pending = invoker->_pending.load(std::memory_order_acquire);
+        invoker->invoke();
+        if ( invoker->_pending.fetch_sub(pending, std::memory_order_acq_rel) == pending ) return;
+    }
+}
+
+int ThreadPool::enqueue(Invoker* invoker)
+{
+    if ( invoker->_pending.fetch_add(1, std::memory_order_acq_rel) ) return 0; // pending or running
+    for (PoolWorker* worker : _workers) {
+        if ( worker->current() ) { // from a worker : keep it local, others steal
+            if ( worker->_deque.push(invoker) ) wakeIdle(worker);
+            else worker->_inbox.push(invoker);
+            return 0;
+        }
+    }
+    PoolWorker* worker = _workers[_nextWorker++ % _workers.size()];
+    worker->_inbox.push(invoker);
+    worker->wake();
+    return 0;
+}
+
+int IRAM_ATTR ThreadPool::enqueueFromIsr(Invoker* invoker)
+{
+    if ( invoker->_pending.fetch_add(1, std::memory_order_acq_rel) ) return 0;
+    PoolWorker* worker = _workers[_nextWorker++ % _workers.size()];
+    worker->_inbox.push(invoker);
+    worker->wakeFromIsr();
+    return 0;
+}
+
+Invoker* ThreadPool::steal(PoolWorker* thief)
+{
+    for (uint32_t i = 1; i < _workers.size(); i++) {
+        PoolWorker* victim = _workers[(thief->_index + i) % _workers.size()];
+        Invoker* invoker = victim->_deque.steal();
+        if ( invoker ) return invoker;
+    }
+    return 0;
+}
+
+void ThreadPool::wakeIdle(PoolWorker* from)
+{
+    for (uint32_t i = 1; i < _workers.size(); i++) {
+        PoolWorker* worker = _workers[(from->_index + i) % _workers.size()];
+        if ( worker->_idle ) {
+            worker->wake();
+            return;
+        }
+    }
+}
+#endif
@@ -0,0 +1,142 @@
+#ifndef THREADPOOL_H
+#define THREADPOOL_H
+#include <NanoAkka.h>
+#ifndef NO_ATOMIC
+//__________________________________________________________________________
+//
+// ThreadPool : a Dispatcher for flows that keep no state between messages,
+// their invokers run on whichever worker is free
+// - a worker takes from the bottom of its own deque, an idle worker steals
+//   from the top of the others
+// - work from outside the pool enters through the inbox of a worker
+// - an invoker runs on one worker at a time, so the values of one sink are
+//   handled in order
+//
+//  ThreadPool pool("pool");  // a worker per core
+//  pool.start();
+//  jsonSink.async(pool, [](const MqttMessage &m) { ... });
+//
+//__________________________________________________________________________
+#define POOL_DEQUE_SIZE 64  // power of 2, more goes to the inbox
+#define POOL_IDLE_MSEC 10   // an idle worker looks for work to steal
+#define POOL_STACK_SIZE 8192
+//
+// bounded work stealing deque ( Chase-Lev, C11 memory model by Le et al. )
+// push and take by the owner only, steal from any worker
+// the indexes run free, differences are taken as int32_t
+//
+class StealingDeque {
+  static constexpr uint32_t MASK = POOL_DEQUE_SIZE - 1;
+  std::atomic<uint32_t> _top;  // thieves
+  char _padding[CACHE_LINE_SIZE];  // workers are on the heap : no alignas
+  std::atomic<uint32_t> _bottom;  // owner
+  std::atomic<Invoker *> _slots[POOL_DEQUE_SIZE];
+
+ public:
+  StealingDeque() : _top(0), _bottom(0) {}
+  bool push(Invoker *invoker) {
+    uint32_t b = _bottom.load(std::memory_order_relaxed);
+    uint32_t t = _top.load(std::memory_order_acquire);
+    if ((int32_t)(b - t) >= POOL_DEQUE_SIZE) return false;
+    _slots[b & MASK].store(invoker, std::memory_order_relaxed);
+    std::atomic_thread_fence(std::memory_order_release);
+    _bottom.store(b + 1, std::memory_order_relaxed);
+    return true;
+  }
+  Invoker *take() {
+    uint32_t b = _bottom.load(std::memory_order_relaxed) - 1;
+    _bottom.store(b, std::memory_order_relaxed);
+    std::atomic_thread_fence(std::memory_order_seq_cst);
+    uint32_t t = _top.load(std::memory_order_relaxed);
+    if ((int32_t)(b - t) < 0) {  // empty
+      _bottom.store(b + 1, std::memory_order_relaxed);
+      return 0;
+    }
+    Invoker *invoker = _slots[b & MASK].load(std::memory_order_relaxed);
+    if (b == t) {  // the last one, race a thief for it
+      if (!_top.compare_exchange_strong(t, t + 1, std::memory_order_seq_cst,
+                                        std::memory_order_relaxed))
+        invoker = 0;
+      _bottom.store(b + 1, std::memory_order_relaxed);
+    }
+    return invoker;
+  }
+  // 0 when empty or when another thief or the owner was faster
+  Invoker *steal() {
+    uint32_t t = _top.load(std::memory_order_acquire);
+    std::atomic_thread_fence(std::memory_order_seq_cst);
+    uint32_t b = _bottom.load(std::memory_order_acquire);
+    if ((int32_t)(b - t) <= 0) return 0;
+    Invoker *invoker = _slots[t & MASK].load(std::memory_order_relaxed);
+    if (!_top.compare_exchange_strong(t, t + 1, std::memory_order_seq_cst,
+                                      std::memory_order_relaxed))
+      return 0;
+    return invoker;
+  }
+};
+
+typedef struct {
+  uint32_t invokes = 0;  // invokers run
+  uint32_t steals = 0;   // of those taken from another worker
+  uint32_t sleeps = 0;   // times it found no work at all
+} PoolStats;
+
+class ThreadPool;
+
+class PoolWorker {
+  friend class ThreadPool;
+  ThreadPool &_pool;
+  uint32_t _index;
+  StealingDeque _deque;
+  InvokerQueue _inbox;
+  std::atomic<bool> _idle;
+  std::atomic<bool> _running;  // from start() until run() returned
+  PoolStats _stats;
+#if defined(FREERTOS)
+  TaskHandle_t _task = 0;
+#elif defined(LINUX)
+  std::thread::id _id;
+  std::mutex _mutex;
+  std::condition_variable _wakeup;
+  std::atomic<bool> _signal;
+#endif
+  void wake();
+  void wakeFromIsr();
+  void sleep(uint32_t msec);
+  bool current();
+  Invoker *next();
+
+ public:
+  PoolWorker(ThreadPool &pool, uint32_t index);
+  void start(const char *name);
+  void run();
+};
+
+class ThreadPool : public Dispatcher {
+  friend class PoolWorker;
+  NanoString _name;
+  std::vector<PoolWorker *> _workers;
+  std::atomic<uint32_t> _nextWorker;  // round robin for work from outside
+  std::atomic<bool> _stop;
+  void run(Invoker *invoker);
+  Invoker *steal(PoolWorker *thief);
+  void wakeIdle(PoolWorker *from);
+
+ public:
+  // workers 0 : one per core
+  ThreadPool(const char *name, uint32_t workers = 0);
+  ~ThreadPool();
+  void start();
+  // the workers return and their tasks end, queued invokers are not run
+  void stop();
+  int enqueue(Invoker *invoker);
+  int enqueueFromIsr(Invoker *invoker);
+  uint32_t size() const { return _workers.size(); }
+  static uint32_t cores();
+  const PoolStats &poolStats(uint32_t worker) const {
+    return _workers[worker]->_stats;
+  }
+};
+
+#endif  // NO_ATOMIC
+#endif
@@ -19,7 +19,7 @@ class Pinger : public Actor {
 
  public:
   ValueSource<int> out;
-  Sink<int, 4> in;
+  Sink<int, 4, QUEUE_SPSC> in;
   Pinger(Thread &thr) : Actor(thr) {
     in.async(thread(), [&](const int &i) { out = _counter++; });
   }
@@ -32,7 +32,7 @@ class Echo : public Actor {
  public:
   ValueSource<int> msgPerMsec = 0;
   ValueSource<int> out;
-  Sink<int, 4> in;
+  Sink<int, 4, QUEUE_SPSC> in;
   Echo(Thread &thr) : Actor(thr) {
     in.async(thread(), [&](const int &i) {
       if (i % DELTA == 0) {
@@ -57,6 +57,7 @@ class BiFlow : public Flow<T, T> {
   BiFlow() {}
   BiFlow(T t) { _t[0] = std::move(t); }
   void request() { this->emit(_t[_idx & 1]); }
+  uint32_t credit() { return UINT32_MAX; }  // only keeps, emits on request
 
   void on(const T &in) {
     _t[(_idx + 1) & 1] = std::move(in);
@@ -70,7 +71,9 @@ class RequestFlow : public Flow<T, T> {
 
  public:
   RequestFlow(Source<T> &source) : _source(source) {}
-  void request() { _source.request(); }
+  void request() {
+    if (this->demand()) _source.request();
+  }
   void on(const T &t) { this->emit(t); }
 };
 //____________________________________________________________________________________
@@ -84,9 +87,17 @@ class Poller : public Actor {
   ValueFlow<bool> connected;
   ValueFlow<uint32_t> interval = 500;
   Poller(Thread &t) : Actor(t), _pollInterval(t, 1, 500, true) {
+    _pollInterval.slack(100);
     _pollInterval >> [&](const TimerMsg tm) {
-      if (_requestables.size() && connected())
-        _requestables[_idx++ % _requestables.size()]->request();
+      if (!connected()) return;
+      // pass by the ones without demand, their value would be dropped
+      for (uint32_t i = 0; i < _requestables.size(); i++) {
+        Requestable *rq = _requestables[_idx++ % _requestables.size()];
+        if (rq->demand()) {
+          rq->request();
+          return;
+        }
+      }
     };
     interval >> [&](const uint32_t iv) { _pollInterval.interval(iv); };
   };
@@ -183,6 +194,15 @@ ValueSource<std::string> systemHostname("NOT SET");
 ValueSource<bool> systemAlive = true;
 LambdaSource<uint32_t> systemHeap([]() { return Sys::getFreeHeap(); });
 LambdaSource<uint64_t> systemUptime([]() { return Sys::millis(); });
+LambdaSource<uint32_t> ledStack([]() { return ledThread.stackFree(); });
+LambdaSource<uint32_t> mqttStack([]() { return mqttThread.stackFree(); });
+LambdaSource<uint32_t> workerStack([]() { return workerThread.stackFree(); });
+#ifdef INVOKER_STATS
+PercentileSource mqttWait(mqtt.outgoing.invokerStats().wait, 99);
+PercentileSource mqttExec(mqtt.outgoing.invokerStats().exec, 99);
+LambdaSource<uint32_t> mqttQueue(
+    []() { return mqttThread.threadStats().queueHighWater; });
+#endif
 Poller poller(mqttThread);
 
 ArrayQueue<int, 16> q;
@@ -265,7 +285,7 @@ extern "C" void app_main(void) {
     }
     uint64_t end = Sys::millis();
     uint32_t delta = end - start;
-    uint32_t mpms = max / delta;
+    uint32_t mpms = max / (delta ? delta : 1);
     INFO(" time taken for %u iterations : %u msec  = %u msg/msec", max, delta,
          mpms);
   }
@@ -293,11 +313,24 @@ extern "C" void app_main(void) {
   systemBuild >> mqtt.toTopic<std::string>("system/build");
   systemAlive >> mqtt.toTopic<bool>("system/alive");
   poller(systemUptime)(systemHeap)(systemHostname)(systemBuild)(systemAlive);
+  // least free stack per thread, to size the stacks on measured need
+  ledStack >> mqtt.toTopic<uint32_t>("system/stack/led");
+  mqttStack >> mqtt.toTopic<uint32_t>("system/stack/mqtt");
+  workerStack >> mqtt.toTopic<uint32_t>("system/stack/worker");
+  poller(ledStack)(mqttStack)(workerStack);
+#ifdef INVOKER_STATS
+  // usec p99 of the mqtt publish sink, most invokers queued on its thread
+  mqttWait >> mqtt.toTopic<uint32_t>("system/mqtt/waitP99");
+  mqttExec >> mqtt.toTopic<uint32_t>("system/mqtt/execP99");
+  mqttQueue >> mqtt.toTopic<uint32_t>("system/mqtt/queueHighWater");
+  poller(mqttWait)(mqttExec)(mqttQueue);
+#endif
 
   Sink<int, 3> intSink([](int i) { INFO("received an int %d", i); });
   mqtt.fromTopic<int>("os/int") >> intSink;
 
   TimerSource logTimer(thisThread, 1, 20000, true);
+  logTimer.slack(1000);
   logTimer >> ([](const TimerMsg &tm) {
     INFO(
         " ovfl : %u busyPop : %u busyPush : %u threadQovfl : %u  Cas : %u / %u "
@@ -305,6 +338,20 @@ extern "C" void app_main(void) {
         stats.bufferOverflow, stats.bufferPopBusy, stats.bufferPushBusy,
         stats.threadQueueOverflow, stats.bufferPushCasFailed,
         stats.bufferPopCasFailed, stats.bufferCasRetries);
+    const ThreadStats &ts = thisThread.threadStats();
+    INFO(" wakeups : %u/sec, timers coalesced : %u",
+         thisThread.wakeupsPerSec(), ts.timersCoalesced);
+    for (uint32_t lane = 0; lane < THREAD_LANES; lane++)
+      if (ts.laneInvokes[lane])
+        INFO(" lane %u : %u invokes latency avg %u max %u usec", lane,
+             ts.laneInvokes[lane],
+             (uint32_t)(ts.laneTotalLatency[lane] / ts.laneInvokes[lane]),
+             ts.laneMaxLatency[lane]);
+    thisThread.resetThreadStats();
+    const Histogram &wl = workerThread.wakeLatency();
+    INFO(" worker wake latency : p50 %u p99 %u max %u usec", wl.percentile(50),
+         wl.percentile(99), wl.maxValue());
+    workerThread.resetThreadStats();
   });
 
 #ifdef COMMAND
@@ -416,7 +463,8 @@ extern "C" void app_main(void) {
 
   rotaryEncoder.init();
   rotaryEncoder.isrCounter >> mqtt.toTopic<uint32_t>("motor/isrCounter");
-  poller(rotaryEncoder.isrCounter);
+  rotaryEncoder.isrLatency >> mqtt.toTopic<uint32_t>("motor/isrLatency");
+  poller(rotaryEncoder.isrCounter)(rotaryEncoder.isrLatency);
 
   motor.init();
   rotaryEncoder.rpmMeasured >> motor.rpmMeasured;
@@ -522,6 +570,10 @@ extern "C" void app_main(void) {
   //  pinger.start();
   ledThread.start();
   mqttThread.start();
+  workerThread.core(APP_CPU);  // control work off the WiFi core
+#if defined(STEPPER) || defined(DWM1000_TAG)
+  workerThread.waitStrategy(WAIT_SPIN_THEN_BLOCK, 100);  // below tick latency
+#endif
   workerThread.start();
   stm32Thread.start();
   thisThread.run();  // DON'T EXIT , local variable will be destroyed
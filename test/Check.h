@@ -0,0 +1,31 @@
+#ifndef CHECK_H
+#define CHECK_H
+#include <Log.h>
+#include <Sys.h>
+//__________________________________________________________________________
+//
+// host test checks : a failed CHECK is logged and counted, main() returns
+// checkFailures() so ctest sees it
+//
+inline uint32_t &checkFailures() {
+  static uint32_t failures = 0;
+  return failures;
+}
+#define CHECK(cond)                              \
+  do {                                           \
+    if (!(cond)) {                               \
+      ERROR("CHECK failed : %s", #cond);         \
+      checkFailures()++;                         \
+    }                                            \
+  } while (0)
+// true when cond() held within msec, for work done on other threads
+template <class COND>
+bool waitUntil(COND cond, uint32_t msec) {
+  uint64_t end = Sys::millis() + msec;
+  while (!cond()) {
+    if (Sys::millis() > end) return false;
+    Sys::delay(1);
+  }
+  return true;
+}
+#endif
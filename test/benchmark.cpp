@@ -0,0 +1,286 @@
+#include <Broadcast.h>
+#include <Kernels.h>
+#include <MedianFilter.h>
+#include <NanoAkka.h>
+#include <Pipeline.h>
+#include <ThreadPool.h>
+#include <string.h>
+//
+// host benchmarks of the core, one section per argument or all of them
+//
+//  nanoakka_bench            // all
+//  nanoakka_bench queue      // one
+//
+#define PAIRS_MAX 4
+#define QUEUE_VALUES 1000000
+
+// producer/consumer pairs, each on its own queue : msg/msec of all pairs
+template <int MODE>
+uint32_t queuePairs(uint32_t pairs) {
+  typedef ArrayQueue<uint32_t, 64, MODE> Queue;
+  Queue *queues = new Queue[pairs];
+  std::atomic<uint32_t> failures(0);
+  std::vector<std::thread> threads;
+  uint64_t start = Sys::millis();
+  for (uint32_t p = 0; p < pairs; p++) {
+    Queue &q = queues[p];
+    threads.emplace_back([&q]() {
+      for (uint32_t i = 0; i < QUEUE_VALUES; i++)
+        while (q.push(i)) std::this_thread::yield();
+    });
+    threads.emplace_back([&q, &failures]() {
+      uint32_t v;
+      for (uint32_t i = 0; i < QUEUE_VALUES; i++) {
+        while (q.pop(v)) std::this_thread::yield();
+        if (v != i) failures++;
+      }
+    });
+  }
+  for (auto &thread : threads) thread.join();
+  uint32_t delta = Sys::millis() - start;
+  delete[] queues;
+  if (failures) ERROR(" out of order : %u", failures.load());
+  return (uint64_t)pairs * QUEUE_VALUES / (delta ? delta : 1);
+}
+
+void queueBenchmark() {
+  for (uint32_t pairs = 1; pairs <= PAIRS_MAX; pairs *= 2)
+    INFO(" queue %u pairs : cas %u spsc %u mpmc %u msg/msec", pairs,
+         queuePairs<QUEUE_CAS>(pairs), queuePairs<QUEUE_SPSC>(pairs),
+         queuePairs<QUEUE_MPMC>(pairs));
+}
+
+// synchronous emit to a lambda
+void dispatchBenchmark() {
+  uint32_t max = 1000000;
+  uint32_t sum = 0;
+  ValueSource<uint32_t> source;
+  source >> [&](const uint32_t &i) { sum += i; };
+  uint64_t start = Sys::millis();
+  for (uint32_t i = 0; i < max; i++) source = i;
+  uint32_t delta = Sys::millis() - start;
+  INFO(" emit->lambda : %u dispatches in %u msec = %u msg/msec [%u]", max,
+       delta, max / (delta ? delta : 1), sum);
+}
+
+// an async sink on a thread that carries more and more timers : msg/msec
+// when saturated, and the latency from enqueue to invoke at 1 msg/msec
+#define TIMER_VALUES 200000
+#define LATENCY_VALUES 500
+void timerBenchmark() {
+  Thread thread("timers");
+  Sink<uint32_t, 64> sink;
+  std::atomic<uint32_t> done(0);
+  sink.async(thread, [&](const uint32_t &) { done++; });
+  uint32_t timers = 0;
+  for (uint32_t count : {0, 10, 100, 1000}) {
+    for (; timers < count; timers++) {  // added while the thread is stopped
+      TimerSource *timer =
+          new TimerSource(thread, timers, 20 + timers % 100, true);
+      *timer >> [](const TimerMsg &) {};
+    }
+    thread.start();
+    done = 0;
+    uint64_t start = Sys::millis();
+    for (uint32_t i = 0; i < TIMER_VALUES; i++) {
+      while (sink.credit() == 0) std::this_thread::yield();
+      sink.on(i);
+    }
+    while (done < TIMER_VALUES) std::this_thread::yield();
+    uint32_t delta = Sys::millis() - start;
+    thread.stop();
+    thread.resetThreadStats();
+    thread.start();
+    for (uint32_t i = 0; i < LATENCY_VALUES; i++) {
+      sink.on(i);
+      Sys::delay(1);
+    }
+    thread.stop();
+    const ThreadStats &ts = thread.threadStats();
+    uint32_t lane = sink.priority();
+    INFO(" %u timers : %u msg/msec, latency avg %u max %u usec", count,
+         TIMER_VALUES / (delta ? delta : 1),
+         (uint32_t)(ts.laneTotalLatency[lane] /
+                    (ts.laneInvokes[lane] ? ts.laneInvokes[lane] : 1)),
+         ts.laneMaxLatency[lane]);
+  }
+}
+
+int plusOne(int &out, const int &in) {
+  out = in + 1;
+  return 0;
+}
+
+// 3 stages : Flows wired with >> against one fused pipeline, nsec per value
+void pipelineBenchmark() {
+  uint32_t max = 1000000;
+  uint32_t sum = 0;
+  ValueSource<int> dynamicSource;
+  ValueSource<int> fusedSource;
+  LambdaFlow<int, int> first(plusOne), second(plusOne), third(plusOne);
+  dynamicSource >> first >> second >> third >>
+      [&](const int &i) { sum += i; };
+  auto stages = stage<int, int>(plusOne) >> stage<int, int>(plusOne) >>
+                stage<int, int>(plusOne);
+  PipelineFlow<decltype(stages)> fused(stages);
+  fusedSource >> fused >> [&](const int &i) { sum += i; };
+  uint64_t start = Sys::micros();
+  for (uint32_t i = 0; i < max; i++) dynamicSource = i;
+  uint32_t nsecDynamic = (Sys::micros() - start) * 1000 / max;
+  start = Sys::micros();
+  for (uint32_t i = 0; i < max; i++) fusedSource = i;
+  uint32_t nsecFused = (Sys::micros() - start) * 1000 / max;
+  INFO(" 3 stages : dynamic %u nsec, fused %u nsec per value [%u]",
+       nsecDynamic, nsecFused, sum);
+}
+
+// cpu bound stateless work spread over a pool, throughput per worker count
+#define POOL_SINKS 8
+uint32_t crunch(uint32_t x) {
+  for (int i = 0; i < 1000; i++) x = x * 1103515245 + 12345;
+  return x;
+}
+
+void poolBenchmark() {
+  uint32_t max = 20000;
+  Sink<uint32_t, 256> sinks[POOL_SINKS];
+  for (uint32_t workers = 1; workers <= ThreadPool::cores(); workers++) {
+    ThreadPool pool("bench", workers);
+    pool.start();
+    std::atomic<uint32_t> done(0);
+    std::atomic<uint32_t> checksum(0);
+    for (uint32_t i = 0; i < POOL_SINKS; i++)
+      sinks[i].async(pool, [&](const uint32_t &x) {
+        checksum ^= crunch(x);
+        done++;
+      });
+    uint64_t start = Sys::millis();
+    for (uint32_t i = 0; i < max; i++) {
+      while (sinks[i % POOL_SINKS].credit() == 0) std::this_thread::yield();
+      sinks[i % POOL_SINKS].on(i);
+    }
+    while (done < max) Sys::delay(1);
+    uint32_t delta = Sys::millis() - start;
+    INFO(" pool %u workers : %u jobs in %u msec = %u jobs/sec [%X]", workers,
+         max, delta, max * 1000 / (delta ? delta : 1), checksum.load());
+  }  // the pool stops its workers
+}
+
+// one producer to n async readers : one ring against a sink per reader
+#define BROADCAST_READERS 4
+typedef struct {
+  uint32_t seq;
+  uint32_t payload[15];
+} BenchMsg;
+
+void broadcastBenchmark() {
+  uint32_t max = 100000;
+  for (uint32_t readers = 1; readers <= BROADCAST_READERS; readers++) {
+    Thread *threads[BROADCAST_READERS];
+    for (uint32_t i = 0; i < readers; i++) {
+      threads[i] = new Thread("bcast");
+      threads[i]->start();
+    }
+    std::atomic<uint32_t> done(0);
+    std::atomic<uint32_t> checksum(0);
+    BroadcastFlow<BenchMsg, 64> ring;
+    for (uint32_t i = 0; i < readers; i++)
+      ring.async(*threads[i]) >> [&](const BenchMsg &m) {
+        checksum += m.seq;
+        done++;
+      };
+    BenchMsg msg = {};
+    uint64_t start = Sys::millis();
+    for (msg.seq = 0; msg.seq < max; msg.seq++) {
+      while (ring.credit() == 0) std::this_thread::yield();
+      ring.on(msg);
+    }
+    while (done < max * readers) std::this_thread::yield();
+    uint32_t deltaRing = Sys::millis() - start;
+
+    done = 0;
+    Sink<BenchMsg, 64> *sinks = new Sink<BenchMsg, 64>[readers];
+    for (uint32_t i = 0; i < readers; i++)
+      sinks[i].async(*threads[i], [&](const BenchMsg &m) {
+        checksum += m.seq;
+        done++;
+      });
+    start = Sys::millis();
+    for (msg.seq = 0; msg.seq < max; msg.seq++)
+      for (uint32_t i = 0; i < readers; i++) {
+        while (sinks[i].credit() == 0) std::this_thread::yield();
+        sinks[i].on(msg);
+      }
+    while (done < max * readers) std::this_thread::yield();
+    uint32_t deltaSinks = Sys::millis() - start;
+    INFO(" %u readers : broadcast %u msg/msec, sink per reader %u msg/msec [%u]",
+         readers, max / (deltaRing ? deltaRing : 1),
+         max / (deltaSinks ? deltaSinks : 1), checksum.load());
+    for (uint32_t i = 0; i < readers; i++) {
+      threads[i]->stop();  // before the readers and sinks go
+      delete threads[i];
+    }
+    delete[] sinks;
+  }  // the ring deletes its readers
+}
+
+// nsec per sample : MedianFilter against the Kernels.h medians
+template <class FILTER>
+uint32_t medianNsec(FILTER &filter, uint32_t max, int32_t &sum) {
+  uint32_t x = 12345;
+  uint64_t start = Sys::micros();
+  for (uint32_t i = 0; i < max; i++) {
+    x = x * 1103515245 + 12345;
+    filter.addSample((int32_t)(x >> 20));
+    sum += filter.getMedian();
+  }
+  return (Sys::micros() - start) * 1000 / max;
+}
+
+void medianBenchmark() {
+  uint32_t max = 20000;
+  int32_t sum = 0;
+  MedianFilter<int32_t, 5> mf5;
+  FastMedian<int32_t, 5> fm5;
+  INFO(" median 5 : MedianFilter %u nsec, network %u nsec",
+       medianNsec(mf5, max, sum), medianNsec(fm5, max, sum));
+  MedianFilter<int32_t, 10> mf10;
+  FastMedian<int32_t, 10> fm10;
+  INFO(" median 10 : MedianFilter %u nsec, network %u nsec",
+       medianNsec(mf10, max, sum), medianNsec(fm10, max, sum));
+  MedianFilter<int32_t, 31> mf31;
+  FastMedian<int32_t, 31> fm31;
+  INFO(" median 31 : MedianFilter %u nsec, sliding %u nsec",
+       medianNsec(mf31, max, sum), medianNsec(fm31, max, sum));
+  // 8 channels of 5 samples, one call against a filter per channel
+  int32_t samples[5 * 8];
+  int32_t medians[8];
+  for (uint32_t i = 0; i < 5 * 8; i++) samples[i] = i * 7919 % 1000;
+  uint64_t start = Sys::micros();
+  for (uint32_t i = 0; i < max / 8; i++) {
+    samples[i % (5 * 8)] ^= i;
+    medianChannels<5>(samples, medians, 8);
+    sum += medians[i % 8];
+  }
+  INFO(" median 5 x 8 channels : %u nsec per channel [%d]",
+       (uint32_t)((Sys::micros() - start) * 1000 / max), sum);
+}
+
+struct Benchmark {
+  const char *name;
+  void (*run)();
+} benchmarks[] = {
+    {"queue", queueBenchmark},
+    {"dispatch", dispatchBenchmark},
+    {"timers", timerBenchmark},
+    {"pipeline", pipelineBenchmark},
+    {"pool", poolBenchmark},
+    {"broadcast", broadcastBenchmark},
+    {"median", medianBenchmark},
+};
+
+int main(int argc, char **argv) {
+  for (const Benchmark &benchmark : benchmarks)
+    if (argc < 2 || strcmp(argv[1], benchmark.name) == 0) benchmark.run();
+  return 0;
+}
@@ -0,0 +1,325 @@
+#include <Broadcast.h>
+#include <Filter.h>
+#include <NanoAkka.h>
+
+#include <vector>
+
+#include "Check.h"
+//
+// Delegate and the synchronous paths of sources, sinks and flows
+//
+static_assert(std::is_constructible<Delegate<void(int)>, int (*)(int)>::value,
+              "a void delegate drops the result");
+static_assert(!std::is_constructible<Delegate<int(int)>, void (*)(int)>::value,
+              "no result for an int delegate");
+static_assert(!std::is_constructible<Delegate<int *(int)>, int (*)(int)>::value,
+              "int does not convert to int*");
+static_assert(!std::is_constructible<Delegate<void(int)>, int>::value,
+              "not callable");
+
+void delegates() {
+  static int seen = 0;
+  Delegate<void(int)> dropResult = [](int x) { return seen = x; };
+  dropResult(3);
+  CHECK(seen == 3);
+  Delegate<long(int)> widen = [](int x) { return (short)(x * 2); };
+  CHECK(widen(21) == 42);
+  Delegate<long(int)> copy = widen;
+  CHECK(copy(1) == 2);
+}
+
+// subclasses that only override on(const T&) get the rvalues too
+class CountingSink : public Sink<int, 2> {
+ public:
+  int count = 0;
+  void on(const int &) { count++; }
+};
+class CountingQueueFlow : public QueueFlow<int, 2> {
+ public:
+  int count = 0;
+  void on(const int &) { count++; }
+};
+class CountingValueFlow : public ValueFlow<int> {
+ public:
+  int count = 0;
+  void on(const int &) { count++; }
+};
+
+void rvalueOverrides() {
+  // a single subscriber gets the temporary emitted as rvalue
+  LambdaSource<int> toSink([]() { return 7; });
+  LambdaSource<int> toQueueFlow([]() { return 7; });
+  LambdaSource<int> toValueFlow([]() { return 7; });
+  CountingSink sink;
+  CountingQueueFlow queueFlow;
+  CountingValueFlow valueFlow;
+  toSink >> sink;
+  toQueueFlow >> queueFlow;
+  toValueFlow >> valueFlow;
+  toSink.request();
+  toQueueFlow.request();
+  toValueFlow.request();
+  CHECK(sink.count == 1);
+  CHECK(queueFlow.count == 1);
+  CHECK(valueFlow.count == 1);
+}
+
+// a synchronous sink and flows still pass an rvalue on
+void rvalueSync() {
+  static int received = 0;
+  LambdaSource<int> source([]() { return 5; });
+  Sink<int, 2> sink([](const int &i) { received += i; });
+  QueueFlow<int, 2> queueFlow;
+  ValueFlow<int> valueFlow;
+  source >> sink;
+  source >> queueFlow;
+  source >> valueFlow;
+  queueFlow >> [](const int &i) { received += i; };
+  valueFlow >> [](const int &i) { received += i; };
+  source.request();
+  CHECK(received == 15);
+  CHECK(valueFlow() == 5);
+}
+
+// demand() through flows wired in a loop, and from threads at once : a
+// probe on one thread is no loop for the other
+void demandProbes() {
+  static Thread idle("idle");  // never started, the sink stays full
+  static Sink<int, 2> full;
+  full.async(idle, [](const int &) {});
+  full.on(1);
+  full.on(2);
+  CHECK(full.credit() == 0);
+  static QueueFlow<int, 2> a, b;
+  a == b;
+  CHECK(a.demand() == UINT32_MAX);
+  b >> full;
+  CHECK(a.demand() == 0);
+  std::atomic<uint32_t> spurious(0);
+  std::vector<std::thread> threads;
+  for (int t = 0; t < 4; t++)
+    threads.emplace_back([&]() {
+      for (int i = 0; i < 1000000; i++)
+        if (a.demand() != 0) spurious++;
+    });
+  for (auto &thread : threads) thread.join();
+  CHECK(spurious == 0);
+}
+
+// a ring of 8 to 3 readers, one held back : the producer's credit follows
+// the slowest reader, every reader sees every value in order
+#define RING_VALUES 20000
+void broadcast() {
+  Thread *threads[3];
+  for (int i = 0; i < 3; i++) {
+    threads[i] = new Thread("reader");
+    threads[i]->start();
+  }
+  BroadcastFlow<uint32_t, 8> ring;
+  std::atomic<uint32_t> next[3];
+  std::atomic<uint32_t> outOfOrder(0);
+  std::atomic<bool> hold(true);
+  for (int i = 0; i < 3; i++) {
+    next[i] = 0;
+    std::atomic<uint32_t> &expected = next[i];
+    bool slow = i == 2;
+    ring.async(*threads[i]) >> [&, slow](const uint32_t &v) {
+      while (slow && hold) std::this_thread::yield();
+      if (v != expected) outOfOrder++;
+      expected = v + 1;
+    };
+  }
+  for (uint32_t v = 0; v < 8; v++) ring.on(v);
+  CHECK(waitUntil([&]() { return next[0] == 8 && next[1] == 8; }, 1000));
+  CHECK(ring.credit() == 0);  // the fast readers are done, the slow one not
+  ring.on(8u);
+  CHECK(ring.dropped() == 1);
+  hold = false;
+  CHECK(waitUntil([&]() { return ring.credit() == 8; }, 1000));
+  for (uint32_t v = 8; v < RING_VALUES; v++) {
+    while (ring.credit() == 0) std::this_thread::yield();
+    ring.on(v);
+  }
+  CHECK(waitUntil(
+      [&]() {
+        return next[0] == RING_VALUES && next[1] == RING_VALUES &&
+               next[2] == RING_VALUES;
+      },
+      2000));
+  CHECK(outOfOrder == 0);
+  CHECK(ring.dropped() == 1);
+  for (int i = 0; i < 3; i++) {
+    threads[i]->stop();  // before the ring and its readers go
+    delete threads[i];
+  }
+}
+
+//
+// Filter.h operators, the time based ones on a simulated clock
+//
+template <class T>
+class Collect : public Subscriber<T> {
+ public:
+  std::vector<T> values;
+  void on(const T &t) { values.push_back(t); }
+  bool is(std::vector<T> expected) { return values == expected; }
+};
+
+void operators() {
+  ValueFlow<int> in;
+  Map<int, int> twice([](const int &v) { return v * 2; });
+  Filter<int> positive([](const int &v) { return v > 0; });
+  Collect<int> mapped;
+  in >> twice >> positive >> mapped;
+  for (int v : {3, -1, 0, 5}) in.on(v);
+  CHECK(mapped.is({6, 10}));
+
+  DistinctUntilChanged<int> distinct(2);
+  Collect<int> changes;
+  distinct >> changes;
+  for (int v : {10, 11, 12, 13, 9, 9, 20}) distinct.on(v);
+  CHECK(changes.is({10, 13, 9, 20}));
+  DistinctUntilChanged<int> anyChange;
+  Collect<int> any;
+  anyChange >> any;
+  for (int v : {0, 0, 1, 1, 0}) anyChange.on(v);
+  CHECK(any.is({0, 1, 0}));
+
+  Window<int, 3> tumbling(false);
+  Collect<int> tumbled;
+  tumbling >> tumbled;
+  for (int v = 1; v <= 7; v++) tumbling.on(v);
+  CHECK(tumbled.is({2, 5}));
+  // oldest first, also after the write position wrapped several times
+  Window<int, 3> sliding(true, [](const int *values, uint32_t count) {
+    return values[0] * 100 + values[1] * 10 + values[2];
+  });
+  Collect<int> slid;
+  sliding >> slid;
+  for (int v = 1; v <= 8; v++) sliding.on(v);
+  CHECK(slid.is({123, 234, 345, 456, 567, 678}));
+
+  Batch<int, 4> batch;
+  Collect<std::array<int, 4>> batches;
+  batch >> batches;
+  for (int v = 0; v < 10; v++) batch.on(v);
+  CHECK(batches.values.size() == 2);
+  CHECK(batches.values.size() == 2 && batches.values[0][0] == 0 &&
+        batches.values[0][3] == 3 && batches.values[1][0] == 4 &&
+        batches.values[1][3] == 7);
+
+  Scan<int, long> sum(100, [](const long &acc, const int &v) { return acc + v; });
+  Collect<long> sums;
+  sum >> sums;
+  for (int v : {1, 2, 3}) sum.on(v);
+  CHECK(sums.is({101, 103, 106}));
+
+  ValueFlow<int> left, right;
+  Merge<int> merge;
+  Collect<int> merged;
+  left >> merge;
+  right >> merge;
+  merge >> merged;
+  left.on(1);
+  right.on(2);
+  left.on(3);
+  CHECK(merged.is({1, 2, 3}));
+
+  ValueFlow<int> x, y;
+  CombineLatest<int, int, int> combined(
+      [](const int &a, const int &b) { return a * 10 + b; });
+  Collect<int> combinations;
+  x >> combined.first;
+  y >> combined.second;
+  combined >> combinations;
+  x.on(1);  // nothing before both delivered
+  x.on(2);
+  y.on(5);
+  y.on(6);
+  x.on(3);
+  CHECK(combinations.is({25, 26, 36}));
+
+  Median<int, 5> median;  // a sorting network
+  Collect<int> medians;
+  median >> medians;
+  for (int v : {9, 1, 8, 2, 7, 100, 3}) median.on(v);
+  CHECK(medians.is({7, 7, 7}));
+  Median<int, 21> wide;  // the heaps
+  Collect<int> wideMedians;
+  wide >> wideMedians;
+  for (int v = 0; v < 22; v++) wide.on(v % 2 ? v : -v);
+  CHECK(wideMedians.is({0, 1}));
+}
+
+void timedOperators() {
+  Thread &thread = *new Thread("operators");
+  Simulation simulation;
+  simulation(thread);
+  Clock::simulate(0);
+
+  Debounce<int> debounce(thread, 50);
+  Collect<int> quiet;
+  debounce >> quiet;
+  for (int v = 1; v <= 5; v++) {  // a burst, 10 msec apart
+    debounce.on(v);
+    simulation.run(10);
+  }
+  CHECK(quiet.values.empty());
+  simulation.run(60);
+  CHECK(quiet.is({5}));
+  debounce.on(6);
+  simulation.run(49);
+  CHECK(quiet.is({5}));
+  simulation.run(2);
+  CHECK(quiet.is({5, 6}));
+  simulation.run(200);
+  CHECK(quiet.is({5, 6}));
+
+  Sample<int> sample(thread, 100);
+  Collect<int> sampled;
+  sample >> sampled;
+  simulation.run(5);
+  sample.on(1);
+  sample.on(2);
+  simulation.run(100);
+  CHECK(sampled.is({2}));
+  simulation.run(300);  // nothing new, nothing emitted
+  CHECK(sampled.is({2}));
+  sample.on(3);
+  simulation.run(100);
+  CHECK(sampled.is({2, 3}));
+
+  Throttle<int> throttle(100);
+  Collect<int> throttled;
+  throttle >> throttled;
+  for (int v = 0; v < 50; v++) {  // one per 10 msec for 500 msec
+    throttle.on(v);
+    simulation.run(10);
+  }
+  CHECK(throttled.values.size() >= 4 && throttled.values.size() <= 5);
+  for (size_t i = 1; i < throttled.values.size(); i++)
+    CHECK(throttled.values[i] - throttled.values[i - 1] >= 10);
+
+  TimeoutFlow<int> timeout(thread, 100, -1);
+  Collect<int> watched;
+  timeout >> watched;
+  timeout.on(1);
+  simulation.run(50);
+  timeout.on(2);
+  simulation.run(50);
+  CHECK(watched.is({1, 2}));
+  simulation.run(60);
+  CHECK(watched.is({1, 2, -1}));
+}
+
+int main() {
+  delegates();
+  rvalueOverrides();
+  rvalueSync();
+  demandProbes();
+  broadcast();
+  operators();
+  timedOperators();  // the clock stays simulated
+  INFO("flow_test : %u failures", checkFailures());
+  return checkFailures() ? 1 : 0;
+}
@@ -0,0 +1,132 @@
+#include <Kernels.h>
+
+#include <algorithm>
+#include <random>
+#include <vector>
+
+#include "Check.h"
+//
+// Kernels against a sort or a min / max over the same window, on random
+// samples with few distinct values so duplicates are common
+//
+static std::mt19937 rng(1234);
+
+int32_t sample() { return (int32_t)(rng() % 64) - 32; }
+
+// the upper of the two middle values for even N, as the kernels do
+int32_t sortedMedian(std::vector<int32_t> window) {
+  std::sort(window.begin(), window.end());
+  return window[window.size() / 2];
+}
+
+template <int N>
+void network() {
+  uint32_t wrong = 0;
+  for (int round = 0; round < 10000; round++) {
+    int32_t p[N];
+    for (int i = 0; i < N; i++) p[i] = sample();
+    std::vector<int32_t> window(p, p + N);
+    if (MedianNetwork<int32_t, N>::median(p) != sortedMedian(window)) wrong++;
+  }
+  if (wrong) ERROR("MedianNetwork<%d> : %u wrong medians", N, wrong);
+  CHECK(wrong == 0);
+}
+
+// the vector lanes and the scalar rest of medianChannels
+template <int N>
+void channels() {
+  const uint32_t CHANNELS = KERNEL_LANES + 3;
+  uint32_t wrong = 0;
+  for (int round = 0; round < 1000; round++) {
+    int32_t samples[N * CHANNELS];
+    int32_t medians[CHANNELS];
+    for (uint32_t i = 0; i < N * CHANNELS; i++) samples[i] = sample();
+    medianChannels<N>(samples, medians, CHANNELS);
+    for (uint32_t c = 0; c < CHANNELS; c++) {
+      std::vector<int32_t> window;
+      for (int i = 0; i < N; i++) window.push_back(samples[i * CHANNELS + c]);
+      if (medians[c] != sortedMedian(window)) wrong++;
+    }
+  }
+  CHECK(wrong == 0);
+}
+
+// the window wraps many times over, ready only after N samples
+template <class MEDIAN, int N>
+void sliding() {
+  MEDIAN median;
+  std::vector<int32_t> history;
+  uint32_t wrong = 0;
+  for (int i = 0; i < 20 * N + 7; i++) {
+    int32_t t = sample();
+    median.addSample(t);
+    history.push_back(t);
+    CHECK(median.isReady() == (i + 1 >= N));
+    if (i + 1 < N) continue;
+    std::vector<int32_t> window(history.end() - N, history.end());
+    if (median.getMedian() != sortedMedian(window)) wrong++;
+  }
+  if (wrong) ERROR("median of %d : %u wrong", N, wrong);
+  CHECK(wrong == 0);
+}
+
+template <int N>
+void runningStats() {
+  RunningStats<int32_t, N> stats;
+  std::vector<int32_t> history;
+  uint32_t wrong = 0;
+  for (int i = 0; i < 20 * N + 7; i++) {
+    int32_t t = sample();
+    stats.add(t);
+    history.push_back(t);
+    uint32_t n = history.size() < N ? history.size() : N;
+    CHECK(stats.count() == n);
+    std::vector<int32_t> window(history.end() - n, history.end());
+    double sum = 0, squares = 0;
+    for (int32_t v : window) sum += v;
+    double mean = sum / n;
+    for (int32_t v : window) squares += (v - mean) * (v - mean);
+    if (stats.min() != *std::min_element(window.begin(), window.end()) ||
+        stats.max() != *std::max_element(window.begin(), window.end()) ||
+        std::abs(stats.mean() - mean) > 1e-3 ||
+        std::abs(stats.variance() - squares / n) > 1e-2)
+      wrong++;
+  }
+  if (wrong) ERROR("RunningStats<%d> : %u wrong", N, wrong);
+  CHECK(wrong == 0);
+}
+
+// a monotone run keeps every sample a min or max candidate
+void runningStatsMonotone() {
+  RunningStats<int32_t, 8> stats;
+  for (int32_t t = 0; t < 100; t++) {
+    stats.add(t);
+    CHECK(stats.max() == t);
+    CHECK(stats.min() == (t < 8 ? 0 : t - 7));
+  }
+}
+
+int main() {
+  network<3>();
+  network<5>();
+  network<7>();
+  network<9>();
+  network<4>();  // odd-even transposition
+  network<10>();
+  network<11>();
+  network<16>();
+  channels<5>();
+  channels<9>();
+  sliding<NetworkMedian<int32_t, 5>, 5>();
+  sliding<NetworkMedian<int32_t, 6>, 6>();
+  sliding<SlidingMedian<int32_t, 17>, 17>();
+  sliding<SlidingMedian<int32_t, 32>, 32>();
+  sliding<SlidingMedian<int32_t, 2>, 2>();
+  sliding<SlidingMedian<int32_t, 3>, 3>();
+  runningStats<1>();
+  runningStats<7>();
+  runningStats<16>();
+  runningStatsMonotone();
+  INFO("kernels_test : %u failures", checkFailures());
+  return checkFailures() ? 1 : 0;
+}
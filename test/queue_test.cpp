@@ -0,0 +1,221 @@
+#include <NanoAkka.h>
+
+#include "Check.h"
+//
+// ArrayQueue and InvokerQueue under contention : every value pushed is
+// popped exactly once
+//
+#define PRODUCERS 8
+#define CONSUMERS 2
+#define VALUES 200000
+
+// 8 producers keep a 16 slot queue full : a push only fails on a full
+// queue, the producer retries it
+void mpmcSaturation() {
+  static ArrayQueue<uint32_t, 16, QUEUE_MPMC> queue;
+  std::atomic<uint32_t> busy(0);  // failures other than full
+  std::atomic<uint32_t> full(0);
+  std::atomic<uint32_t> popped(0);
+  std::atomic<uint64_t> sum(0);
+  std::vector<std::atomic<uint32_t>> seen(PRODUCERS * VALUES / 32 + 1);
+  std::atomic<uint32_t> duplicates(0);
+  std::vector<std::thread> threads;
+  for (uint32_t p = 0; p < PRODUCERS; p++)
+    threads.emplace_back([&, p]() {
+      for (uint32_t i = 0; i < VALUES; i++) {
+        uint32_t v = p * VALUES + i;
+        int rc;
+        while ((rc = (i & 1) ? queue.pushFromIsr(v) : queue.push(v)) != 0) {
+          if (rc == ENOBUFS)
+            full++;
+          else
+            busy++;
+          std::this_thread::yield();
+        }
+      }
+    });
+  for (uint32_t c = 0; c < CONSUMERS; c++)
+    threads.emplace_back([&]() {
+      uint32_t v;
+      while (popped < PRODUCERS * VALUES) {
+        if (queue.pop(v)) {
+          std::this_thread::yield();
+          continue;
+        }
+        uint32_t bit = 1u << (v % 32);
+        if (seen[v / 32].fetch_or(bit) & bit) duplicates++;
+        sum += v;
+        popped++;
+      }
+    });
+  for (auto &thread : threads) thread.join();
+  uint64_t n = (uint64_t)PRODUCERS * VALUES;
+  CHECK(popped == n);
+  CHECK(sum == n * (n - 1) / 2);
+  CHECK(duplicates == 0);
+  CHECK(busy == 0);
+  CHECK(queue.space() == 16);
+  INFO(" mpmc : %u values, %u pushes on a full queue", popped.load(),
+       full.load());
+}
+
+// one slot : the capacity is rounded up to 2, not down to a single cell
+void mpmcSingleSlot() {
+  ArrayQueue<int, 1, QUEUE_MPMC> queue;
+  int v = 0;
+  CHECK(queue.push(1) == 0);
+  CHECK(queue.push(2) == 0);
+  CHECK(queue.push(3) == ENOBUFS);
+  CHECK(queue.pop(v) == 0 && v == 1);
+  CHECK(queue.pop(v) == 0 && v == 2);
+  CHECK(queue.pop(v) == ENOBUFS);
+  for (int i = 0; i < 100; i++) {
+    CHECK(queue.push(i) == 0);
+    CHECK(queue.pop(v) == 0 && v == i);
+  }
+}
+
+// the default mode of sinks and queue flows, with a single slot
+void singleSlotSink() {
+  static std::atomic<uint32_t> handled(0);
+  Thread &thread = *new Thread("sink");
+  thread.start();
+  Sink<int, 1> *sink = new Sink<int, 1>();
+  sink->async(thread, [](const int &) { handled++; });
+  QueueFlow<int, 1> *flow = new QueueFlow<int, 1>();
+  flow->async(thread);
+  *flow >> [](const int &) { handled++; };
+  for (int i = 0; i < 1000; i++) {
+    while (sink->credit() == 0) std::this_thread::yield();
+    sink->on(i);
+    while (flow->credit() == 0) std::this_thread::yield();
+    flow->on(i);
+  }
+  CHECK(waitUntil([]() { return handled == 2000; }, 2000));
+}
+
+void spscOrder() {
+  static ArrayQueue<uint32_t, 8, QUEUE_SPSC> queue;
+  std::atomic<uint32_t> outOfOrder(0);
+  std::thread consumer([&]() {
+    uint32_t v;
+    for (uint32_t i = 0; i < VALUES; i++) {
+      while (queue.pop(v)) std::this_thread::yield();
+      if (v != i) outOfOrder++;
+    }
+  });
+  for (uint32_t i = 0; i < VALUES; i++)
+    while (queue.push(i)) std::this_thread::yield();
+  consumer.join();
+  CHECK(outOfOrder == 0);
+}
+
+// triple buffer : a value is never torn, values come out in push order, and
+// after the last push the last value is what a pop gets. Every push is
+// either popped or counted as overwritten
+struct Wide {
+  uint32_t seq;
+  uint32_t copies[15];  // all equal to seq
+};
+
+void latestTripleBuffer() {
+  static ArrayQueue<Wide, 1, QUEUE_LATEST> queue;
+  std::atomic<bool> done(false);
+  std::atomic<uint32_t> torn(0);
+  std::atomic<uint32_t> backwards(0);
+  uint32_t pops = 0;
+  uint32_t last = 0;
+  std::thread consumer([&]() {
+    Wide w;
+    while (true) {
+      bool finished = done;  // read before the pop : the last value is in
+      if (queue.pop(w) == 0) {
+        for (uint32_t i = 0; i < 15; i++)
+          if (w.copies[i] != w.seq) torn++;
+        if (w.seq <= last) backwards++;
+        last = w.seq;
+        pops++;
+      } else if (finished) {
+        return;
+      } else {
+        std::this_thread::yield();
+      }
+    }
+  });
+  for (uint32_t seq = 1; seq <= VALUES; seq++) {
+    Wide w;
+    w.seq = seq;
+    for (uint32_t i = 0; i < 15; i++) w.copies[i] = seq;
+    queue.push(w);
+    if (seq % 8 == 0) std::this_thread::yield();  // interleave on one core too
+  }
+  done = true;
+  consumer.join();
+  CHECK(torn == 0);
+  CHECK(backwards == 0);
+  CHECK(last == VALUES);
+  CHECK(pops + queue.overwrites() == VALUES);
+  INFO(" latest : %u pops, %u overwritten", pops, queue.overwrites());
+}
+
+// the intrusive run queue of Thread : millions of pushes from 4 threads,
+// an invoker is pushed again once the consumer popped it
+#define INVOKER_PUSHES 1000000
+#define INVOKERS_PER_PRODUCER 8
+class CountedInvoker : public Invoker {
+ public:
+  std::atomic<bool> queued{false};
+  uint32_t pushes = 0;
+  uint32_t pops = 0;
+  void invoke() {}
+};
+
+void invokerQueue() {
+  static InvokerQueue queue;
+  const uint32_t producers = 4;
+  CountedInvoker *invokers =
+      new CountedInvoker[producers * INVOKERS_PER_PRODUCER];
+  std::atomic<uint32_t> popped(0);
+  std::vector<std::thread> threads;
+  for (uint32_t p = 0; p < producers; p++)
+    threads.emplace_back([&, p]() {
+      CountedInvoker *own = invokers + p * INVOKERS_PER_PRODUCER;
+      for (uint32_t i = 0; i < INVOKER_PUSHES; i++) {
+        CountedInvoker &invoker = own[i % INVOKERS_PER_PRODUCER];
+        while (invoker.queued.load(std::memory_order_acquire))
+          std::this_thread::yield();
+        invoker.queued.store(true, std::memory_order_relaxed);
+        invoker.pushes++;
+        queue.push(&invoker);
+      }
+    });
+  threads.emplace_back([&]() {
+    while (popped < producers * INVOKER_PUSHES) {
+      CountedInvoker *invoker = (CountedInvoker *)queue.pop();
+      if (invoker == 0) {
+        std::this_thread::yield();
+        continue;
+      }
+      invoker->pops++;
+      invoker->queued.store(false, std::memory_order_release);
+      popped++;
+    }
+  });
+  for (auto &thread : threads) thread.join();
+  CHECK(popped == producers * INVOKER_PUSHES);
+  CHECK(queue.pop() == 0);
+  for (uint32_t i = 0; i < producers * INVOKERS_PER_PRODUCER; i++)
+    CHECK(invokers[i].pops == invokers[i].pushes);
+  delete[] invokers;
+}
+
+int main() {
+  mpmcSaturation();
+  mpmcSingleSlot();
+  singleSlotSink();
+  spscOrder();
+  latestTripleBuffer();
+  invokerQueue();
+  INFO("queue_test : %u failures", checkFailures());
+  return checkFailures() ? 1 : 0;
+}
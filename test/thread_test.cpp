@@ -0,0 +1,256 @@
+#include <MicroTimer.h>
+#include <NanoAkka.h>
+#include <ThreadPool.h>
+
+#include "Check.h"
+//
+// the Linux backend of Thread : enqueues from other threads, timer wakeups,
+// the ISR entry point, lanes, wait strategies and stop(), a
+// MicroTimerSource and a ThreadPool. The objects live on the heap : the
+// test thread is still running when main() returns.
+//
+#define PRODUCERS 4
+#define VALUES 20000
+
+void crossThreadEnqueue(Thread &thread) {
+  std::atomic<uint64_t> sum(0);
+  std::atomic<uint32_t> count(0);
+  Sink<uint32_t, 64> *sinks = new Sink<uint32_t, 64>[PRODUCERS];
+  for (uint32_t i = 0; i < PRODUCERS; i++)
+    sinks[i].async(thread, [&](const uint32_t &v) {
+      sum += v;
+      count++;
+    });
+  std::vector<std::thread> producers;
+  for (uint32_t p = 0; p < PRODUCERS; p++)
+    producers.emplace_back([&, p]() {
+      for (uint32_t v = 1; v <= VALUES; v++) {
+        while (sinks[p].credit() == 0) std::this_thread::yield();
+        sinks[p].on(v);
+      }
+    });
+  for (auto &producer : producers) producer.join();
+  CHECK(waitUntil([&]() { return count == PRODUCERS * VALUES; }, 5000));
+  CHECK(sum == (uint64_t)PRODUCERS * VALUES * (VALUES + 1) / 2);
+  for (uint32_t i = 0; i < PRODUCERS; i++) CHECK(sinks[i].dropped() == 0);
+}
+
+// timers are added before the thread starts, as the actors do
+static std::atomic<uint32_t> ticks(0);
+static std::atomic<uint64_t> oneShotAt(0);
+uint64_t timersStart;
+
+void addTimers(Thread &thread) {
+  TimerSource *repeating = new TimerSource(thread, 1, 10, true);
+  *repeating >> [](const TimerMsg &) { ticks++; };
+  TimerSource *oneShot = new TimerSource(thread, 2, 50, false);
+  *oneShot >> [](const TimerMsg &) { oneShotAt = Sys::millis(); };
+  timersStart = Sys::millis();
+  oneShot->start();
+}
+
+void timerWakeup() {
+  CHECK(waitUntil([]() { return oneShotAt != 0; }, 1000));
+  uint64_t delay = oneShotAt - timersStart;
+  CHECK(delay >= 50 && delay < 80);
+  uint32_t before = ticks;
+  Sys::delay(300);
+  uint32_t t = ticks - before;
+  CHECK(t >= 25 && t <= 36);
+}
+
+void enqueueFromIsr(Thread &thread) {
+  static std::atomic<uint32_t> values(0);
+  Sink<int, 4> *sink = new Sink<int, 4>();
+  sink->async(thread, [](const int &) { values++; });
+  sink->onFromIsr(1);
+  CHECK(waitUntil([]() { return values == 1; }, 1000));
+}
+
+// an idle thread stops without waiting for its 5 sec maximum wait
+// the running thread resets its own stats, at its next pass
+void resetStats(Thread &thread) {
+  CHECK(thread.threadStats().invokes > 0);
+  thread.resetThreadStats();
+  CHECK(waitUntil([&]() { return thread.threadStats().invokes == 0; }, 100));
+}
+
+// a 2 msec MicroTimerSource : the expiries keep to the period from start()
+// on, late emits don't push the next expiry out. Deleted after stop()
+#define MICRO_INTERVAL 2000
+#define MICRO_EXPIRIES 250
+void microTimer(Thread &thread) {
+  static MicroTimerSource *timer =
+      new MicroTimerSource(thread, 7, MICRO_INTERVAL, true);
+  static uint64_t start = 0;
+  static uint64_t reached = 0;
+  static std::atomic<uint32_t> emits(0);
+  *timer >> [](const TimerMsg &) {
+    emits++;
+    if (reached == 0 && timer->fired() >= MICRO_EXPIRIES)
+      reached = Sys::micros();
+  };
+  start = Sys::micros();
+  timer->start();
+  CHECK(waitUntil([]() { return reached != 0; }, 2000));
+  timer->stop();
+  Sys::delay(10);
+  uint64_t periods = MICRO_EXPIRIES + timer->missed();
+  uint64_t elapsed = reached - start;
+  CHECK(elapsed >= periods * MICRO_INTERVAL);
+  CHECK(elapsed < periods * MICRO_INTERVAL + 10 * MICRO_INTERVAL);  // drift
+  CHECK(emits >= MICRO_EXPIRIES * 9 / 10);  // a few coalesced at most
+  CHECK(timer->jitter().percentile(50) < MICRO_INTERVAL);
+  INFO(" micro timer : %llu usec for %llu periods, jitter p50 %u max %u usec",
+       elapsed, periods, timer->jitter().percentile(50),
+       timer->jitter().maxValue());
+  uint32_t stopped = emits;
+  Sys::delay(20);
+  CHECK(emits == stopped);
+  delete timer;
+}
+
+// invokers queued by several producers while the thread is stopped : the
+// high water is taken when the thread pops, after start() all are in
+#define HIGH_WATER_SINKS 8
+void queueHighWater() {
+  static std::atomic<uint32_t> served(0);
+  Thread *thread = new Thread("highWater");
+  Sink<int, 4> *sinks = new Sink<int, 4>[PRODUCERS * HIGH_WATER_SINKS];
+  for (uint32_t i = 0; i < PRODUCERS * HIGH_WATER_SINKS; i++)
+    sinks[i].async(*thread, [](const int &) { served++; });
+  std::vector<std::thread> producers;
+  for (uint32_t p = 0; p < PRODUCERS; p++)
+    producers.emplace_back([sinks, p]() {
+      for (uint32_t i = 0; i < HIGH_WATER_SINKS; i++)
+        sinks[p * HIGH_WATER_SINKS + i].on(1);
+    });
+  for (auto &producer : producers) producer.join();
+  thread->start();
+  CHECK(waitUntil([]() { return served == PRODUCERS * HIGH_WATER_SINKS; }, 1000));
+  CHECK(thread->threadStats().queueHighWater == PRODUCERS * HIGH_WATER_SINKS);
+  thread->stop();
+  delete thread;
+}
+
+// invokers queued in both lanes while the thread is stopped : once started
+// the high lane is served first, each lane in enqueue order
+class Recorder final : public Invoker {
+  std::vector<int> &_order;
+  int _id;
+
+ public:
+  Recorder(std::vector<int> &order, int id, uint8_t lane)
+      : _order(order), _id(id) {
+    priority(lane);
+  }
+  void invoke() { _order.push_back(_id); }
+};
+
+void laneOrder() {
+  static std::vector<int> order;
+  Thread *thread = new Thread("lanes");
+  std::vector<Recorder *> recorders;
+  for (int id = 0; id < 8; id++)  // normal on even, high on odd ids
+    recorders.push_back(new Recorder(
+        order, id, id & 1 ? PRIORITY_HIGH : PRIORITY_NORMAL));
+  for (auto recorder : recorders) thread->enqueue(recorder);
+  thread->start();
+  CHECK(waitUntil([]() { return order.size() == 8; }, 1000));
+  thread->stop();
+  CHECK((order == std::vector<int>{1, 3, 5, 7, 0, 2, 4, 6}));
+  CHECK(thread->threadStats().laneInvokes[PRIORITY_HIGH] == 4);
+  CHECK(thread->threadStats().laneInvokes[PRIORITY_NORMAL] == 4);
+  delete thread;
+  for (auto recorder : recorders) delete recorder;
+}
+
+// each wait strategy : a timer fires on time, and an invoke queued while
+// no timer is due wakes the thread instead of waiting for one
+void waitStrategies() {
+  static std::atomic<uint64_t> firedAt(0);
+  static std::atomic<uint64_t> servedAt(0);
+  const char *names[] = {"block", "spinThenBlock", "yieldSpin"};
+  for (uint8_t strategy : {WAIT_BLOCK, WAIT_SPIN_THEN_BLOCK, WAIT_YIELD_SPIN}) {
+    Thread *thread = new Thread(names[strategy]);
+    thread->waitStrategy(strategy, 200);
+    TimerSource *oneShot = new TimerSource(*thread, 3, 50, false);
+    *oneShot >> [](const TimerMsg &) { firedAt = Sys::millis(); };
+    Sink<int, 4> *sink = new Sink<int, 4>();
+    sink->async(*thread, [](const int &) { servedAt = Sys::millis(); });
+    firedAt = 0;
+    servedAt = 0;
+    thread->start();
+    uint64_t start = Sys::millis();
+    oneShot->start();
+    CHECK(waitUntil([]() { return firedAt != 0; }, 1000));
+    uint64_t delay = firedAt - start;
+    if (delay < 50 || delay >= 80)
+      ERROR("%s : timer after %llu msec", names[strategy], delay);
+    CHECK(delay >= 50 && delay < 80);
+    Sys::delay(20);  // the thread is waiting again, no timer due
+    uint64_t enqueued = Sys::millis();
+    sink->on(1);
+    CHECK(waitUntil([]() { return servedAt != 0; }, 1000));
+    CHECK(servedAt - enqueued < 20);
+    thread->stop();
+    oneShot->stop();
+    delete thread;
+  }
+}
+
+void stopThread() {
+  Thread *thread = new Thread("stop");
+  thread->start();
+  Sys::delay(10);
+  uint64_t start = Sys::millis();
+  thread->stop();
+  CHECK(Sys::millis() - start < 100);
+  delete thread;
+}
+
+// values of one sink stay in order on a pool, deleting it ends the workers
+#define POOL_SINKS 4
+void threadPool() {
+  static std::atomic<uint32_t> outOfOrder(0);
+  static std::atomic<uint32_t> handled(0);
+  static uint32_t next[POOL_SINKS] = {};
+  ThreadPool *pool = new ThreadPool("pool", 3);
+  pool->start();
+  Sink<uint32_t, 16> *sinks = new Sink<uint32_t, 16>[POOL_SINKS];
+  for (uint32_t i = 0; i < POOL_SINKS; i++) {
+    uint32_t *expected = &next[i];
+    sinks[i].async(*pool, [expected](const uint32_t &v) {
+      if (v != (*expected)++) outOfOrder++;
+      handled++;
+    });
+  }
+  for (uint32_t v = 0; v < VALUES; v++)
+    for (uint32_t i = 0; i < POOL_SINKS; i++) {
+      while (sinks[i].credit() == 0) std::this_thread::yield();
+      sinks[i].on(v);
+    }
+  CHECK(waitUntil([]() { return handled == POOL_SINKS * VALUES; }, 5000));
+  CHECK(outOfOrder == 0);
+  uint64_t start = Sys::millis();
+  delete pool;
+  CHECK(Sys::millis() - start < 100);
+}
+
+int main() {
+  Thread &thread = *new Thread("test");
+  addTimers(thread);
+  thread.start();
+  timerWakeup();
+  crossThreadEnqueue(thread);
+  enqueueFromIsr(thread);
+  microTimer(thread);
+  resetStats(thread);
+  queueHighWater();
+  laneOrder();
+  waitStrategies();
+  stopThread();
+  threadPool();
+  INFO("thread_test : %u failures", checkFailures());
+  return checkFailures() ? 1 : 0;
+}
@@ -0,0 +1,159 @@
+#include <NanoAkka.h>
+
+#include "Check.h"
+//
+// the timer heap of Thread, in virtual time : the same passes on every run
+//
+Thread thread("timers");
+Simulation simulation;
+
+uint64_t since(uint64_t start) { return Clock::millis() - start; }
+
+// repeating timers fire at their own rate, whatever the others do
+void rates() {
+  static uint32_t counts[3] = {};
+  TimerSource *t10 = new TimerSource(thread, 10, 10, true);
+  TimerSource *t30 = new TimerSource(thread, 30, 30, true);
+  TimerSource *t70 = new TimerSource(thread, 70, 70, true);
+  *t10 >> [](const TimerMsg &) { counts[0]++; };
+  *t30 >> [](const TimerMsg &) { counts[1]++; };
+  *t70 >> [](const TimerMsg &) { counts[2]++; };
+  simulation.run(1000);
+  CHECK(counts[0] == 100);
+  CHECK(counts[1] == 33);
+  CHECK(counts[2] == 14);
+  t10->stop();
+  t30->stop();
+  t70->stop();
+}
+
+// a start() to an earlier time rebuilds the heap, a later one re-keys
+void rearm() {
+  static uint64_t firedAt = 0;
+  static TimerSource *oneShot = new TimerSource(thread, 1, 500, false);
+  *oneShot >> [](const TimerMsg &) { firedAt = Clock::millis(); };
+  uint64_t start = Clock::millis();
+  oneShot->start();
+  simulation.run(100);
+  oneShot->start(50);  // from 500 to 150
+  simulation.run(500);
+  CHECK(firedAt - start == 150);
+  // restarted every 30 msec as a timeout, fires 100 msec after the last
+  static TimerSource *kick = new TimerSource(thread, 2, 30, true);
+  static uint32_t kicks = 0;
+  *kick >> [](const TimerMsg &) {
+    if (++kicks <= 10)
+      oneShot->start(100);
+    else
+      kick->stop();
+  };
+  firedAt = 0;
+  start = Clock::millis();
+  kick->start();
+  simulation.run(1000);
+  CHECK(firedAt - start == 10 * 30 + 100);
+}
+
+// timers due at the same msec fire in one pass
+void samePass() {
+  static uint32_t fired = 0;
+  static uint64_t firedAt[5];
+  for (int i = 0; i < 5; i++) {
+    TimerSource *timer = new TimerSource(thread, 100 + i, 20, false);
+    *timer >> [](const TimerMsg &tm) {
+      firedAt[tm.id - 100] = Clock::millis();
+      fired++;
+    };
+    timer->start();
+  }
+  uint64_t start = Clock::millis();
+  uint64_t passes = simulation.run(100);
+  CHECK(fired == 5);
+  for (int i = 0; i < 5; i++) CHECK(firedAt[i] - start == 20);
+  CHECK(passes == 2);  // the 5 timers, then the end of the run
+}
+
+// slack : a timer with an open window fires along with an earlier one,
+// the lazy one is due 5 msec before the strict one and waits for it
+void slack() {
+  static uint32_t lazyFired = 0;
+  TimerSource *lazy = new TimerSource(thread, 2, 100, true);
+  lazy->slack(20);
+  *lazy >> [](const TimerMsg &) { lazyFired++; };
+  simulation.run(5);
+  TimerSource *strict = new TimerSource(thread, 1, 100, true);
+  *strict >> [](const TimerMsg &) {};
+  uint32_t before = thread.threadStats().timersCoalesced;
+  simulation.run(1000);
+  CHECK(lazyFired == 10);
+  CHECK(thread.threadStats().timersCoalesced - before == 10);
+  strict->stop();
+  lazy->stop();
+}
+
+// 100 timers of different periods : with a window they share wakeups, the
+// passes go down, without one each expiry is a pass of its own. No pass
+// is spent without a timer firing, besides the one ending the run
+static uint64_t lastFire = 0;
+static uint32_t fireTimes = 0;
+
+uint64_t passes(uint32_t slack) {
+  Thread &own = *new Thread("passes");
+  Simulation ownSimulation;
+  ownSimulation(own);
+  TimerSource *timers[100];
+  for (int i = 0; i < 100; i++) {
+    timers[i] = new TimerSource(own, i, 100 + i, true);
+    timers[i]->slack(slack);
+    *timers[i] >> [](const TimerMsg &) {
+      if (Clock::millis() != lastFire) fireTimes++;
+      lastFire = Clock::millis();
+    };
+  }
+  fireTimes = 0;
+  uint64_t count = ownSimulation.run(1000);
+  CHECK(count <= fireTimes + 1);
+  for (int i = 0; i < 100; i++) timers[i]->stop();
+  return count;
+}
+
+void fewerWakeups() {
+  uint64_t strict = passes(0);
+  uint64_t lazy = passes(20);
+  INFO(" 100 timers : %llu passes strict, %llu with slack 20", strict, lazy);
+  CHECK(lazy * 3 < strict);
+}
+
+// an invoker that enqueues itself again keeps the thread busy : the run
+// ends after its passes, the clock does not move
+class Busy : public Invoker {
+ public:
+  bool again = true;
+  void invoke() {
+    if (again) thread.enqueue(this);
+  }
+};
+
+void maxSteps() {
+  static Busy busy;
+  uint64_t start = Clock::millis();
+  thread.enqueue(&busy);
+  CHECK(simulation.run(100, 50) == 50);
+  CHECK(Clock::millis() == start);
+  busy.again = false;
+  simulation.run(100);
+  CHECK(since(start) == 100);
+}
+
+int main() {
+  Clock::simulate(0);
+  simulation(thread);
+  rates();
+  rearm();
+  samePass();
+  slack();
+  fewerWakeups();
+  maxSteps();
+  INFO("timer_test : %u failures", checkFailures());
+  return checkFailures() ? 1 : 0;
+}